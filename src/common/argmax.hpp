@@ -0,0 +1,84 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#ifndef COMMON_ARGMAX_HPP_
+#define COMMON_ARGMAX_HPP_
+
+#include <algorithm>
+
+// Argmax of ArgmaxChannels for positions that are position_step apart, or consecutive when
+// bConsecutive so the compiler knows the step.
+// The channels are compared a block of positions at a time without branches, so the
+// compiler can vectorize it; strided positions are gathered.
+template <typename tLabel, bool bConsecutive>
+void
+ArgmaxChannelsBlocked(const float* data,
+                      const int channels,
+                      const int count,
+                      const int channel_step,
+                      const int position_step,
+                      tLabel* labels)
+{
+  const int step = bConsecutive ? 1 : position_step;
+
+  // the block of maxima and labels is local, so it can't alias the data
+  const int kBlock = 256;
+  float max[kBlock];
+  int block_labels[kBlock];
+  for (int begin = 0; begin < count; begin += kBlock)
+  {
+    const int n = std::min(kBlock, count - begin);
+    const float* pChannel = data + begin * step;
+    for (int i = 0; i < n; i++)
+    {
+      max[i] = pChannel[i * step];
+      block_labels[i] = 0;
+    }
+    for (int c = 1; c < channels; c++)
+    {
+      pChannel = data + c * channel_step + begin * step;
+      for (int i = 0; i < n; i++)
+      {
+        // select with a mask, a conditional assignment stops the vectorizer
+        const float value = pChannel[i * step];
+        const float old = max[i];
+        const int mask = -static_cast<int>(value > old);
+        block_labels[i] = (block_labels[i] & ~mask) | (c & mask);
+        max[i] = (value > old) ? value : old;
+      }
+    }
+    for (int i = 0; i < n; i++)
+    {
+      labels[begin + i] = static_cast<tLabel>(block_labels[i]);
+    }
+  }
+}
+
+// Finds the channel with the highest value for count positions of a net output and writes
+// it to labels, the value of channel c at position i is data[c * channel_step + i * position_step].
+// The lowest channel wins a tie.
+// Positions of a channel are consecutive (position_step 1) in the class maps of a fully
+// convolutional net and interleaved with the channels in the output of a patch net or an MLP.
+template <typename tLabel>
+void
+ArgmaxChannels(const float* data,
+               const int channels,
+               const int count,
+               const int channel_step,
+               const int position_step,
+               tLabel* labels)
+{
+  if (position_step == 1)
+  {
+    ArgmaxChannelsBlocked<tLabel, true>(data, channels, count, channel_step, position_step, labels);
+  }
+  else
+  {
+    ArgmaxChannelsBlocked<tLabel, false>(data, channels, count, channel_step, position_step, labels);
+  }
+}
+
+#endif // COMMON_ARGMAX_HPP_
@@ -0,0 +1,83 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#ifndef COMMON_BOUNDED_QUEUE_HPP_
+#define COMMON_BOUNDED_QUEUE_HPP_
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstddef>
+#include <queue>
+
+// Thread safe FIFO queue that holds at most capacity items, so a producer that is faster
+// than its consumer has to wait instead of using more and more memory.
+template <typename T>
+class BoundedQueue
+{
+public:
+  explicit BoundedQueue(const size_t capacity)
+    : capacity_(capacity > 0 ? capacity : 1)
+    , closed_(false)
+  {
+  }
+
+  // Adds item to the queue, waits while the queue is full.
+  // Returns false, without adding item, when the queue is closed.
+  bool Push(const T& item)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (queue_.size() >= capacity_ && !closed_)
+    {
+      not_full_.wait(lock);
+    }
+    if (closed_)
+    {
+      return false;
+    }
+    queue_.push(item);
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // Takes the oldest item from the queue, waits while the queue is empty.
+  // Returns false when the queue is closed and there are no items left.
+  bool Pop(T* item)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (queue_.empty() && !closed_)
+    {
+      not_empty_.wait(lock);
+    }
+    if (queue_.empty())
+    {
+      return false;
+    }
+    *item = queue_.front();
+    queue_.pop();
+    not_full_.notify_one();
+    return true;
+  }
+
+  // No more items will be pushed, waiting consumers return once the queue is empty and
+  // waiting producers return right away
+  void Close()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    closed_ = true;
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+private:
+  std::queue<T> queue_;
+  const size_t capacity_;
+  bool closed_;
+  boost::mutex mutex_;
+  boost::condition_variable not_empty_;
+  boost::condition_variable not_full_;
+};
+
+#endif // COMMON_BOUNDED_QUEUE_HPP_
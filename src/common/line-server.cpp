@@ -0,0 +1,292 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#include "line-server.hpp"
+
+#include <glog/logging.h>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+
+// write end of the stop pipe of the running server
+int g_stop_fd = -1;
+
+extern "C" void
+Stop(int)
+{
+  const int iErrno = errno;
+  if (g_stop_fd >= 0)
+  {
+    const ssize_t iWritten = write(g_stop_fd, "", 1);
+    (void) iWritten; // a full pipe already wakes up poll
+  }
+  errno = iErrno;
+}
+
+} // namespace
+
+LineServer::LineServer(const std::string& socket_path, const size_t max_batch)
+  : socket_path_(socket_path)
+  , max_batch_(max_batch > 0 ? max_batch : 1)
+  , listen_(-1)
+  , next_client_(0)
+{
+  // a client that goes away must not stop the server
+  std::signal(SIGPIPE, SIG_IGN);
+
+  // SIGINT and SIGTERM make Run return, the handler must never block on the pipe
+  const int iPiped = pipe(stop_);
+  CHECK_EQ(iPiped, 0) << "Cannot create pipe: " << std::strerror(errno);
+  fcntl(stop_[0], F_SETFL, fcntl(stop_[0], F_GETFL) | O_NONBLOCK);
+  fcntl(stop_[1], F_SETFL, fcntl(stop_[1], F_GETFL) | O_NONBLOCK);
+  g_stop_fd = stop_[1];
+  std::signal(SIGINT, Stop);
+  std::signal(SIGTERM, Stop);
+
+  if (socket_path_.empty())
+  {
+    tClient client;
+    client.in = STDIN_FILENO;
+    client.out = STDOUT_FILENO;
+    client.closed = false;
+    clients_.push_back(client);
+    return;
+  }
+
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  CHECK_LT(socket_path_.size(), sizeof(address.sun_path)) << "Socket path too long: " << socket_path_;
+  std::strncpy(address.sun_path, socket_path_.c_str(), sizeof(address.sun_path) - 1);
+
+  listen_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  CHECK_GE(listen_, 0) << "Cannot create socket: " << std::strerror(errno);
+  unlink(socket_path_.c_str());
+  const int iBound = bind(listen_, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+  CHECK_EQ(iBound, 0) << "Cannot bind " << socket_path_ << ": " << std::strerror(errno);
+  const int iListening = listen(listen_, SOMAXCONN);
+  CHECK_EQ(iListening, 0) << "Cannot listen on " << socket_path_ << ": " << std::strerror(errno);
+  fcntl(listen_, F_SETFL, fcntl(listen_, F_GETFL) | O_NONBLOCK);
+}
+
+LineServer::~LineServer()
+{
+  for (size_t i = 0; i < clients_.size(); i++)
+  {
+    if (clients_[i].in != STDIN_FILENO)
+    {
+      close(clients_[i].in);
+    }
+  }
+  if (listen_ >= 0)
+  {
+    close(listen_);
+    unlink(socket_path_.c_str());
+  }
+
+  std::signal(SIGINT, SIG_DFL);
+  std::signal(SIGTERM, SIG_DFL);
+  g_stop_fd = -1;
+  close(stop_[0]);
+  close(stop_[1]);
+}
+
+bool
+LineServer::Read(tClient* client)
+{
+  char buffer[65536];
+  const ssize_t iRead = read(client->in, buffer, sizeof(buffer));
+  if (iRead < 0 && (errno == EINTR || errno == EAGAIN))
+  {
+    return false;
+  }
+  if (iRead <= 0)
+  {
+    // the last line doesn't need a line end
+    if (!client->buffer.empty() && client->buffer[client->buffer.size() - 1] != '\n')
+    {
+      client->buffer += '\n';
+    }
+    client->closed = true;
+    return false;
+  }
+  client->buffer.append(buffer, iRead);
+
+  // the unfinished line starts after the last line end (at 0 when there is none)
+  const size_t iLineBegin = client->buffer.rfind('\n') + 1;
+  if (client->buffer.size() - iLineBegin > kMaxLineLength)
+  {
+    LOG(WARNING) << "Dropped a client that sent a line longer than " << kMaxLineLength << " bytes";
+    Drop(client);
+    return false;
+  }
+  return true;
+}
+
+bool
+LineServer::Flush(tClient* client)
+{
+  while (!client->output.empty())
+  {
+    const ssize_t iWritten = write(client->out, client->output.data(), client->output.size());
+    if (iWritten < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (iWritten < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      return true; // the rest is written when the client can take it
+    }
+    if (iWritten <= 0)
+    {
+      return false;
+    }
+    client->output.erase(0, iWritten);
+  }
+  return true;
+}
+
+void
+LineServer::Drop(tClient* client)
+{
+  client->closed = true;
+  client->buffer.clear();
+  client->output.clear();
+}
+
+void
+LineServer::Run(const tHandler& handler)
+{
+  std::vector<std::string> requests;
+  std::vector<std::string> responses;
+  std::vector<size_t> request_clients; // the client of every request
+  while (listen_ >= 0 || !clients_.empty())
+  {
+    // don't wait for new data when there are lines left from the last time
+    bool bPending = false;
+    for (size_t i = 0; i < clients_.size(); i++)
+    {
+      bPending = bPending || clients_[i].buffer.find('\n') != std::string::npos;
+    }
+
+    // wait for new clients, data and clients that can take their responses, a client with
+    // many unwritten responses isn't read until it takes them
+    std::vector<pollfd> fds;
+    for (size_t i = 0; i < clients_.size(); i++)
+    {
+      const tClient& client = clients_[i];
+      const bool bRead = !client.closed && client.output.size() < kMaxPendingOutput;
+      const pollfd in = {bRead ? client.in : -1, POLLIN, 0};
+      const pollfd out = {client.output.empty() ? -1 : client.out, POLLOUT, 0};
+      fds.push_back(in);
+      fds.push_back(out);
+    }
+    if (listen_ >= 0)
+    {
+      pollfd fd = {listen_, POLLIN, 0};
+      fds.push_back(fd);
+    }
+    const pollfd stop = {stop_[0], POLLIN, 0};
+    fds.push_back(stop);
+    if (poll(&fds[0], fds.size(), bPending ? 0 : -1) < 0)
+    {
+      CHECK_EQ(errno, EINTR) << "poll failed: " << std::strerror(errno);
+      continue;
+    }
+    if (fds.back().revents & POLLIN)
+    {
+      return;
+    }
+
+    // write what the clients can take and read everything that is available
+    for (size_t i = 0; i < clients_.size(); i++)
+    {
+      if (fds[2 * i + 1].revents != 0 && !Flush(&clients_[i]))
+      {
+        Drop(&clients_[i]);
+      }
+      if (fds[2 * i].revents != 0)
+      {
+        Read(&clients_[i]);
+      }
+    }
+    if (listen_ >= 0 && fds[2 * clients_.size()].revents & POLLIN)
+    {
+      const int iClient = accept(listen_, NULL, NULL);
+      if (iClient >= 0)
+      {
+        // stdin and stdout may be shared with other processes, only sockets don't block
+        fcntl(iClient, F_SETFL, fcntl(iClient, F_GETFL) | O_NONBLOCK);
+        tClient client;
+        client.in = iClient;
+        client.out = iClient;
+        client.closed = false;
+        clients_.push_back(client);
+      }
+    }
+
+    // take the complete lines of all clients as one batch, starting with the next client
+    requests.clear();
+    request_clients.clear();
+    for (size_t j = 0; j < clients_.size() && requests.size() < max_batch_; j++)
+    {
+      const size_t i = (next_client_ + j) % clients_.size();
+      std::string& buffer = clients_[i].buffer;
+      size_t iBegin = 0;
+      size_t iEnd = 0;
+      while (requests.size() < max_batch_ && (iEnd = buffer.find('\n', iBegin)) != std::string::npos)
+      {
+        requests.push_back(buffer.substr(iBegin, iEnd - iBegin));
+        request_clients.push_back(i);
+        iBegin = iEnd + 1;
+      }
+      buffer.erase(0, iBegin);
+    }
+
+    if (!requests.empty())
+    {
+      next_client_ = (next_client_ + 1) % clients_.size();
+      responses.clear();
+      handler(requests, &responses);
+      CHECK_EQ(responses.size(), requests.size()) << "Every request needs a response";
+
+      // queue the responses and write as much of them as the clients take
+      for (size_t i = 0; i < responses.size(); i++)
+      {
+        clients_[request_clients[i]].output += responses[i] + '\n';
+      }
+      for (size_t i = 0; i < clients_.size(); i++)
+      {
+        if (!Flush(&clients_[i]))
+        {
+          Drop(&clients_[i]);
+        }
+      }
+    }
+
+    // forget the clients that are done
+    for (size_t i = clients_.size(); i-- > 0; )
+    {
+      if (clients_[i].closed && clients_[i].buffer.find('\n') == std::string::npos &&
+          clients_[i].output.empty())
+      {
+        if (clients_[i].in != STDIN_FILENO)
+        {
+          close(clients_[i].in);
+        }
+        clients_.erase(clients_.begin() + i);
+      }
+    }
+  }
+}
@@ -0,0 +1,73 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#ifndef COMMON_LINE_SERVER_HPP_
+#define COMMON_LINE_SERVER_HPP_
+
+#include <boost/function.hpp>
+#include <string>
+#include <vector>
+
+// Serves requests of a single line, read from stdin or from the clients of a unix domain
+// socket, and writes a response line for every request.
+// All requests that are available at the same time (up to max_batch) are handed to the
+// handler at once, so they can be classified in a single forward pass.
+// SIGINT and SIGTERM stop the server, so what comes after Run (a profile) is still done.
+// Socket clients are served without blocking: responses are buffered per client, and a
+// client isn't read while too many of its responses wait to be written or is dropped when
+// it sends a line longer than kMaxLineLength.
+class LineServer
+{
+public:
+  // handler that fills responses with a response for every request
+  typedef boost::function<void (const std::vector<std::string>& requests,
+                                std::vector<std::string>* responses)> tHandler;
+
+  // serves stdin/stdout when socket_path is empty
+  LineServer(const std::string& socket_path, const size_t max_batch);
+
+  // removes the socket and restores the default SIGINT and SIGTERM handling
+  ~LineServer();
+
+  // Serves requests until stdin is closed or SIGINT or SIGTERM is received
+  void Run(const tHandler& handler);
+
+private:
+  // longest request in bytes
+  static const size_t kMaxLineLength = 65536;
+
+  // bytes of responses that may wait for a client before it isn't read anymore
+  static const size_t kMaxPendingOutput = 1 << 20;
+
+  struct tClient
+  {
+    int in;
+    int out;
+    std::string buffer; // received data that is not handled yet
+    std::string output; // responses that are not written yet
+    bool closed;        // no more data will be received
+  };
+
+  // reads the available data of client, returns false when nothing could be read;
+  // a client with a line longer than kMaxLineLength is dropped
+  static bool Read(tClient* client);
+
+  // writes as much of the output of client as can be written without blocking, returns
+  // false when the client is gone
+  static bool Flush(tClient* client);
+
+  // forgets everything that was received from and is to be sent to client
+  static void Drop(tClient* client);
+
+  const std::string socket_path_;
+  const size_t max_batch_;
+  int listen_;
+  int stop_[2]; // pipe the signal handler writes to, so it wakes up poll
+  std::vector<tClient> clients_;
+  size_t next_client_; // the client a batch starts with, so all clients share the batches
+};
+
+#endif // COMMON_LINE_SERVER_HPP_
@@ -0,0 +1,192 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#include "memory-feed.hpp"
+
+#include <boost/bind.hpp>
+#include <caffe/util/benchmark.hpp>
+#include <caffe/util/upgrade_proto.hpp>
+#include <glog/logging.h>
+
+// Gives the MemoryData layer of the train net the next samples at the start of every
+// iteration, one batch for every forward pass of the iteration
+class MemoryFeed::TrainCallback : public caffe::Solver<float>::Callback
+{
+public:
+  TrainCallback(MemoryFeed* feed, caffe::MemoryDataLayer<float>* layer, const int samples)
+    : feed_(feed)
+    , layer_(layer)
+    , samples_(samples)
+  {
+  }
+
+protected:
+  void on_start()
+  {
+    feed_->Take(samples_, &data_, &labels_);
+    layer_->Reset(&data_[0], &labels_[0], samples_);
+  }
+
+  void on_gradients_ready()
+  {
+  }
+
+private:
+  MemoryFeed* feed_;
+  caffe::MemoryDataLayer<float>* layer_;
+  const int samples_;
+
+  // the samples of the iteration, the layer points at them
+  std::vector<float> data_;
+  std::vector<float> labels_;
+};
+
+void
+MemoryFeed::ReadSolverParameter(const std::string& path, const int sample_size, caffe::SolverParameter* param)
+{
+  caffe::ReadSolverParamsFromTextFileOrDie(path, param);
+  CHECK(!param->net().empty()) << "The solver " << path << " must refer to its net with net:";
+  caffe::NetParameter net_param;
+  caffe::ReadNetParamsFromTextFileOrDie(param->net(), &net_param);
+
+  int iDataLayers = 0;
+  for (int i = 0; i < net_param.layer_size(); i++)
+  {
+    caffe::LayerParameter* layer = net_param.mutable_layer(i);
+    if (layer->type() != "Data")
+    {
+      continue;
+    }
+    const unsigned int iBatchSize = layer->data_param().batch_size();
+    layer->set_type("MemoryData");
+    layer->clear_data_param();
+    layer->clear_transform_param();
+    caffe::MemoryDataParameter* memory_param = layer->mutable_memory_data_param();
+    memory_param->set_batch_size(iBatchSize);
+    memory_param->set_channels(sample_size);
+    memory_param->set_height(1);
+    memory_param->set_width(1);
+    iDataLayers++;
+  }
+  CHECK_GT(iDataLayers, 0) << "The net " << param->net() << " has no Data layer to replace";
+
+  param->clear_net();
+  param->mutable_net_param()->CopyFrom(net_param);
+}
+
+MemoryFeed::MemoryFeed(const tGenerator& generator,
+                       const int sample_size,
+                       const int threads,
+                       const size_t prefetch_samples,
+                       const size_t shuffle_samples,
+                       const unsigned int seed)
+  : generator_(generator)
+  , sample_size_(sample_size)
+  , seed_(seed)
+  , queue_(prefetch_samples)
+  , shuffle_buffer_(shuffle_samples, seed)
+  , stop_(false)
+  , taken_(0)
+  , wait_seconds_(0)
+{
+  for (int i = 0; i < threads; i++)
+  {
+    threads_.create_thread(boost::bind(&MemoryFeed::Generate, this, i));
+  }
+}
+
+MemoryFeed::~MemoryFeed()
+{
+  // a thread that waits for room in the queue holds the shuffle buffer
+  queue_.Close();
+  {
+    boost::mutex::scoped_lock lock(shuffle_mutex_);
+    stop_ = true;
+  }
+  threads_.join_all();
+}
+
+void
+MemoryFeed::Generate(const int thread)
+{
+  boost::mt19937 rng(seed_ + 1 + thread);
+  std::vector<tSample> samples;
+  tSample shuffled;
+  while (true)
+  {
+    samples.clear();
+    generator_(&rng, &samples);
+
+    boost::mutex::scoped_lock lock(shuffle_mutex_);
+    if (stop_)
+    {
+      return;
+    }
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+      CHECK_EQ(samples[i].first.size(), static_cast<size_t>(sample_size_)) << "A sample must have " << sample_size_ << " values";
+      if (shuffle_buffer_.Add(samples[i], &shuffled) && !queue_.Push(shuffled))
+      {
+        return;
+      }
+    }
+  }
+}
+
+void
+MemoryFeed::Take(const int count, std::vector<float>* data, std::vector<float>* labels)
+{
+  caffe::CPUTimer timer;
+  timer.Start();
+  data->resize(static_cast<size_t>(count) * sample_size_);
+  labels->resize(count);
+  tSample sample;
+  for (int i = 0; i < count; i++)
+  {
+    CHECK(queue_.Pop(&sample)) << "The feed is stopped";
+    std::copy(sample.first.begin(), sample.first.end(), data->begin() + static_cast<size_t>(i) * sample_size_);
+    (*labels)[i] = sample.second;
+  }
+  taken_ += count;
+  wait_seconds_ += timer.Seconds();
+}
+
+caffe::MemoryDataLayer<float>*
+MemoryFeed::FindMemoryDataLayer(const caffe::Net<float>& net)
+{
+  for (size_t i = 0; i < net.layers().size(); i++)
+  {
+    caffe::MemoryDataLayer<float>* layer = dynamic_cast<caffe::MemoryDataLayer<float>*>(net.layers()[i].get());
+    if (layer)
+    {
+      return layer;
+    }
+  }
+  LOG(FATAL) << "The net " << net.name() << " has no MemoryData layer";
+  return NULL;
+}
+
+void
+MemoryFeed::Attach(caffe::Solver<float>* solver)
+{
+  // the test nets run test_iter batches per test, the same samples every test
+  const caffe::SolverParameter& param = solver->param();
+  const std::vector<boost::shared_ptr<caffe::Net<float> > >& test_nets = solver->test_nets();
+  test_data_.resize(test_nets.size());
+  test_labels_.resize(test_nets.size());
+  for (size_t i = 0; i < test_nets.size(); i++)
+  {
+    caffe::MemoryDataLayer<float>* layer = FindMemoryDataLayer(*test_nets[i]);
+    const int iSamples = param.test_iter(i) * layer->batch_size();
+    Take(iSamples, &test_data_[i], &test_labels_[i]);
+    layer->Reset(&test_data_[i][0], &test_labels_[i][0], iSamples);
+  }
+
+  // the train net runs iter_size batches per iteration
+  caffe::MemoryDataLayer<float>* layer = FindMemoryDataLayer(*solver->net());
+  callback_.reset(new TrainCallback(this, layer, param.iter_size() * layer->batch_size()));
+  solver->add_callback(callback_.get());
+}
@@ -0,0 +1,88 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#ifndef COMMON_MEMORY_FEED_HPP_
+#define COMMON_MEMORY_FEED_HPP_
+
+#include <boost/function.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+#include <caffe/caffe.hpp>
+#include <caffe/layers/memory_data_layer.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bounded-queue.hpp"
+#include "shuffle-buffer.hpp"
+
+// Feeds a solver with new samples while it trains, without a database in between.
+// Generator threads make samples, which are shuffled in a buffer and then wait in a
+// queue (the prefetched samples) until the solver takes them. Every iteration the train
+// net gets the next samples through its MemoryData layer; the test nets get a fixed set of
+// samples that is taken from the feed once, before training.
+class MemoryFeed
+{
+public:
+  typedef std::pair<std::vector<float>, float> tSample; // input values and label
+
+  // Appends some new samples to samples, using rng for everything that is random
+  typedef boost::function<void (boost::mt19937* rng, std::vector<tSample>* samples)> tGenerator;
+
+  // Reads the solver parameters of path and its net, and replaces the Data layers of the
+  // net by MemoryData layers of the same batch size for samples of sample_size values
+  static void ReadSolverParameter(const std::string& path, const int sample_size, caffe::SolverParameter* param);
+
+  // Starts threads generator threads, each with its own rng seeded from seed and the
+  // thread number
+  MemoryFeed(const tGenerator& generator,
+             const int sample_size,
+             const int threads,
+             const size_t prefetch_samples,
+             const size_t shuffle_samples,
+             const unsigned int seed);
+
+  // stops the generator threads
+  ~MemoryFeed();
+
+  // Gives the test nets of solver their samples and feeds its train net every iteration
+  void Attach(caffe::Solver<float>* solver);
+
+  // Takes the next count samples, waits while they are not generated yet
+  void Take(const int count, std::vector<float>* data, std::vector<float>* labels);
+
+  // number of samples taken and the time (s) spent waiting for samples
+  long taken() const { return taken_; }
+  double wait_seconds() const { return wait_seconds_; }
+
+private:
+  class TrainCallback;
+
+  // generates samples until the feed stops
+  void Generate(const int thread);
+
+  // the MemoryData layer of net
+  static caffe::MemoryDataLayer<float>* FindMemoryDataLayer(const caffe::Net<float>& net);
+
+  const tGenerator generator_;
+  const int sample_size_;
+  const unsigned int seed_;
+  BoundedQueue<tSample> queue_;
+  boost::mutex shuffle_mutex_;
+  ShuffleBuffer<tSample> shuffle_buffer_;
+  bool stop_;
+  boost::thread_group threads_;
+  long taken_;
+  double wait_seconds_;
+
+  // the samples of the test nets, the layers point at them
+  std::vector<std::vector<float> > test_data_;
+  std::vector<std::vector<float> > test_labels_;
+  boost::scoped_ptr<TrainCallback> callback_;
+};
+
+#endif // COMMON_MEMORY_FEED_HPP_
@@ -0,0 +1,66 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+// This program writes a net and its trained model into a single packed file, which the
+// classifiers load with --packed without parsing the net and the model, and reports how
+// long loading takes both ways.
+// Usage:
+//  pack-net NET MODEL PACKED_NET
+//
+
+#include <gflags/gflags.h>
+#include <caffe/caffe.hpp>
+#include <caffe/util/benchmark.hpp>
+#include <string>
+
+#include "packed-net.hpp"
+
+int
+main(int argc, char* argv[])
+{
+  ::google::InitGoogleLogging(argv[0]);
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Writes a net and its trained model into a single packed file\n"
+                          "Usage:\n"
+                          " pack-net NET MODEL PACKED_NET\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 4)
+  {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "pack-net");
+    return 1;
+  }
+
+  const std::string sNetwork = argv[1];
+  const std::string sModel = argv[2];
+  const std::string sPacked = argv[3];
+  std::cout << "packing " << sNetwork << " and " << sModel << " into " << sPacked << std::endl;
+  PackedNet::Write(sNetwork, sModel, sPacked);
+
+  // the files were just read or written, so both loads come from the file cache
+  caffe::CPUTimer timer;
+  timer.Start();
+  {
+    caffe::Net<float> net(sNetwork, caffe::TEST);
+    net.CopyTrainedLayersFrom(sModel);
+  }
+  const double dModelTime = timer.MilliSeconds();
+  timer.Start();
+  {
+    PackedNet packed_net(sPacked);
+    packed_net.CreateNet();
+  }
+  const double dPackedTime = timer.MilliSeconds();
+  std::cout << "loading " << sNetwork << " and " << sModel << " takes " << dModelTime << " ms, "
+            << sPacked << " " << dPackedTime << " ms ("
+            << (dPackedTime > 0 ? dModelTime / dPackedTime : 0) << " times as fast)" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,187 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#include "packed-net.hpp"
+
+#include <caffe/util/upgrade_proto.hpp>
+#include <glog/logging.h>
+#include <boost/cstdint.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+  const char kMagic[8] = {'C', 'A', 'F', 'F', 'E', 'P', 'K', 'D'};
+  const boost::uint32_t kVersion = 1;
+  const boost::uint64_t kAlignment = 64;
+
+  // first offset from offset that is a multiple of kAlignment
+  boost::uint64_t
+  Align(const boost::uint64_t offset)
+  {
+    return (offset + kAlignment - 1) / kAlignment * kAlignment;
+  }
+}
+
+struct PackedNet::tHeader
+{
+  char magic[8];
+  boost::uint32_t version;
+  boost::uint32_t alignment;
+  boost::uint64_t num_entries;   // the table of blob entries follows the header
+  boost::uint64_t param_offset;
+  boost::uint64_t param_size;
+  boost::uint64_t size;          // of the whole file
+};
+
+struct PackedNet::tBlobEntry
+{
+  boost::uint32_t layer;         // index of the layer in the net
+  boost::uint32_t blob;          // index of the blob in the layer
+  boost::uint64_t count;         // number of weights
+  boost::uint64_t offset;        // of the first weight in the file
+};
+
+void
+PackedNet::Write(const std::string& network, const std::string& model, const std::string& path)
+{
+  caffe::NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(network, &param);
+  param.mutable_state()->set_phase(caffe::TEST);
+  std::string sParam;
+  CHECK(param.SerializeToString(&sParam)) << "Cannot serialize " << network;
+
+  caffe::Net<float> net(param);
+  net.CopyTrainedLayersFrom(model);
+
+  // lay out the file
+  std::vector<tBlobEntry> entries;
+  for (size_t i = 0; i < net.layers().size(); i++)
+  {
+    for (size_t j = 0; j < net.layers()[i]->blobs().size(); j++)
+    {
+      tBlobEntry entry;
+      entry.layer = i;
+      entry.blob = j;
+      entry.count = net.layers()[i]->blobs()[j]->count();
+      entry.offset = 0;
+      entries.push_back(entry);
+    }
+  }
+  tHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.alignment = kAlignment;
+  header.num_entries = entries.size();
+  header.param_offset = sizeof(tHeader) + entries.size() * sizeof(tBlobEntry);
+  header.param_size = sParam.size();
+  boost::uint64_t iOffset = header.param_offset + header.param_size;
+  for (size_t i = 0; i < entries.size(); i++)
+  {
+    entries[i].offset = Align(iOffset);
+    iOffset = entries[i].offset + entries[i].count * sizeof(float);
+  }
+  header.size = iOffset;
+
+  std::ofstream file(path.c_str(), std::ios::binary);
+  CHECK(file.good()) << "Cannot write " << path;
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  if (!entries.empty())
+  {
+    file.write(reinterpret_cast<const char*>(&entries[0]), entries.size() * sizeof(tBlobEntry));
+  }
+  file.write(sParam.data(), sParam.size());
+  const char padding[kAlignment] = {0};
+  for (size_t i = 0; i < entries.size(); i++)
+  {
+    file.write(padding, entries[i].offset - file.tellp());
+    const caffe::Blob<float>& blob = *net.layers()[entries[i].layer]->blobs()[entries[i].blob];
+    file.write(reinterpret_cast<const char*>(blob.cpu_data()), blob.count() * sizeof(float));
+  }
+  CHECK(file.good()) << "Cannot write " << path;
+}
+
+PackedNet::PackedNet(const std::string& path)
+  : path_(path)
+  , data_(NULL)
+  , size_(0)
+  , entries_(NULL)
+  , num_entries_(0)
+{
+  const int iFile = open(path_.c_str(), O_RDONLY);
+  CHECK_GE(iFile, 0) << "Cannot open " << path_ << ": " << std::strerror(errno);
+  struct stat status;
+  const int iStat = fstat(iFile, &status);
+  CHECK_EQ(iStat, 0) << "Cannot stat " << path_ << ": " << std::strerror(errno);
+  size_ = status.st_size;
+  CHECK_GE(size_, sizeof(tHeader)) << path_ << " is not a packed net";
+
+  // private and writable, a blob must not be able to change the file
+  void* pData = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, iFile, 0);
+  CHECK(pData != MAP_FAILED) << "Cannot map " << path_ << ": " << std::strerror(errno);
+  close(iFile);
+  data_ = static_cast<char*>(pData);
+
+  const tHeader& header = *reinterpret_cast<const tHeader*>(data_);
+  CHECK(std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0) << path_ << " is not a packed net";
+  CHECK_EQ(header.version, kVersion) << "Unsupported version of " << path_;
+  CHECK_EQ(header.size, size_) << path_ << " is truncated";
+  CHECK_LE(header.param_offset + header.param_size, size_) << path_ << " is corrupt";
+  num_entries_ = header.num_entries;
+  CHECK_LE(sizeof(tHeader) + num_entries_ * sizeof(tBlobEntry), header.param_offset) << path_ << " is corrupt";
+  entries_ = reinterpret_cast<const tBlobEntry*>(data_ + sizeof(tHeader));
+  for (size_t i = 0; i < num_entries_; i++)
+  {
+    CHECK_EQ(entries_[i].offset % kAlignment, 0) << path_ << " is corrupt";
+    CHECK_LE(entries_[i].offset + entries_[i].count * sizeof(float), size_) << path_ << " is corrupt";
+  }
+
+  CHECK(param_.ParseFromArray(data_ + header.param_offset, header.param_size)) << "Cannot parse the net of " << path_;
+
+  // the weights come from the file, so the nets don't need to be filled with random
+  // weights first; the default filler is a constant 0
+  for (int i = 0; i < param_.layer_size(); i++)
+  {
+    caffe::LayerParameter& layer = *param_.mutable_layer(i);
+    if (layer.has_inner_product_param())
+    {
+      layer.mutable_inner_product_param()->clear_weight_filler();
+      layer.mutable_inner_product_param()->clear_bias_filler();
+    }
+    if (layer.has_convolution_param())
+    {
+      layer.mutable_convolution_param()->clear_weight_filler();
+      layer.mutable_convolution_param()->clear_bias_filler();
+    }
+  }
+}
+
+PackedNet::~PackedNet()
+{
+  munmap(data_, size_);
+}
+
+boost::shared_ptr<caffe::Net<float> >
+PackedNet::CreateNet() const
+{
+  boost::shared_ptr<caffe::Net<float> > net(new caffe::Net<float>(param_));
+  for (size_t i = 0; i < num_entries_; i++)
+  {
+    const tBlobEntry& entry = entries_[i];
+    CHECK_LT(entry.layer, net->layers().size()) << path_ << " does not match its net";
+    CHECK_LT(entry.blob, net->layers()[entry.layer]->blobs().size()) << path_ << " does not match its net";
+    caffe::Blob<float>& blob = *net->layers()[entry.layer]->blobs()[entry.blob];
+    CHECK_EQ(static_cast<boost::uint64_t>(blob.count()), entry.count) << path_ << " does not match its net";
+    blob.set_cpu_data(reinterpret_cast<float*>(data_ + entry.offset));
+  }
+  return net;
+}
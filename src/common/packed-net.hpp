@@ -0,0 +1,54 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#ifndef COMMON_PACKED_NET_HPP_
+#define COMMON_PACKED_NET_HPP_
+
+#include <caffe/caffe.hpp>
+#include <boost/shared_ptr.hpp>
+#include <string>
+
+// A net and its trained weights in a single file that is ready to use as it is:
+// - a header and a table with an entry for every blob of weights
+// - the net parameters in the protobuf binary format
+// - the weights of every blob, each starting at a 64 byte boundary
+// The file is mapped into memory and the blobs of the nets point straight at the mapped
+// weights, so the text format of the net and the trained model don't have to be parsed
+// and the weights are not copied or filled. Numbers are stored in the byte order of the
+// machine.
+class PackedNet
+{
+public:
+  // writes the net with the trained weights of model to path
+  static void Write(const std::string& network, const std::string& model, const std::string& path);
+
+  // maps the packed net at path
+  explicit PackedNet(const std::string& path);
+
+  // unmaps the file, the nets that were created may not be used anymore
+  ~PackedNet();
+
+  // Creates a net in the TEST phase that uses the mapped weights; all nets created by
+  // the same object share their weights like with Net::ShareTrainedLayersWith
+  boost::shared_ptr<caffe::Net<float> > CreateNet() const;
+
+private:
+  struct tHeader;
+  struct tBlobEntry;
+
+  // copying would unmap the file twice
+  PackedNet(const PackedNet&);
+  PackedNet& operator=(const PackedNet&);
+
+  const std::string path_;
+  char* data_;
+  size_t size_;
+  const tBlobEntry* entries_;
+  size_t num_entries_;
+  caffe::NetParameter param_;
+};
+
+#endif // COMMON_PACKED_NET_HPP_
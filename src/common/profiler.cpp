@@ -0,0 +1,248 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#include "profiler.hpp"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+namespace
+{
+  // the names in a trace are layer names and tool stages, only quotes and backslashes
+  // need escaping
+  std::string
+  Escape(const std::string& text)
+  {
+    std::string escaped;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+      if (text[i] == '"' || text[i] == '\\')
+      {
+        escaped += '\\';
+      }
+      escaped += text[i];
+    }
+    return escaped;
+  }
+}
+
+Profiler::Stage::Stage(Profiler* profiler)
+  : profiler_(profiler)
+  , name_(NULL)
+  , start_(0)
+{
+}
+
+Profiler::Stage::~Stage()
+{
+  Stop();
+}
+
+void
+Profiler::Stage::Start(const char* name)
+{
+  if (!profiler_)
+  {
+    return;
+  }
+  Stop();
+  name_ = name;
+  start_ = profiler_->Now();
+}
+
+void
+Profiler::Stage::Stop()
+{
+  if (profiler_ && name_)
+  {
+    profiler_->Record(name_, "stage", start_, profiler_->Now(), 0);
+    name_ = NULL;
+  }
+}
+
+Profiler::Profiler()
+  : start_(boost::posix_time::microsec_clock::universal_time())
+  , dropped_(0)
+{
+}
+
+bool
+Profiler::MoreDuration(const tTotal& a, const tTotal& b)
+{
+  return a.duration > b.duration;
+}
+
+void
+Profiler::ForwardFromTo(caffe::Net<float>* net, const int start, const int end)
+{
+  for (int i = start; i <= end; i++)
+  {
+    const caffe::Layer<float>& layer = *net->layers()[i];
+    const double dFlops = LayerFlops(*net, i);
+    const boost::int64_t iStart = Now();
+    net->ForwardFromTo(i, i);
+    Record(layer.layer_param().name() + " (" + layer.type() + ")", "layer", iStart, Now(), dFlops);
+  }
+}
+
+void
+Profiler::ForwardFrom(caffe::Net<float>* net, const int start)
+{
+  ForwardFromTo(net, start, static_cast<int>(net->layers().size()) - 1);
+}
+
+void
+Profiler::Record(const std::string& name, const std::string& category,
+                 const boost::int64_t start, const boost::int64_t end, const double flops)
+{
+  tEvent event;
+  event.name = name;
+  event.category = category;
+  event.start = start;
+  event.duration = end - start;
+  event.flops = flops;
+
+  boost::mutex::scoped_lock lock(mutex_);
+  const boost::thread::id id = boost::this_thread::get_id();
+  std::map<boost::thread::id, int>::const_iterator it = threads_.find(id);
+  if (it == threads_.end())
+  {
+    it = threads_.insert(std::make_pair(id, static_cast<int>(threads_.size()))).first;
+  }
+  event.thread = it->second;
+
+  // the summary counts every event
+  const std::string sKey = category + "/" + name;
+  std::map<std::string, size_t>::const_iterator total_it = total_index_.find(sKey);
+  if (total_it == total_index_.end())
+  {
+    total_it = total_index_.insert(std::make_pair(sKey, totals_.size())).first;
+    totals_.push_back(tTotal());
+    totals_.back().name = name;
+    totals_.back().category = category;
+  }
+  tTotal& total = totals_[total_it->second];
+  total.calls++;
+  total.duration += event.duration;
+  total.flops += flops;
+
+  if (events_.size() < kMaxEvents)
+  {
+    events_.push_back(event);
+  }
+  else
+  {
+    dropped_++;
+  }
+}
+
+boost::int64_t
+Profiler::Now() const
+{
+  return (boost::posix_time::microsec_clock::universal_time() - start_).total_microseconds();
+}
+
+void
+Profiler::WriteTrace(const std::string& path) const
+{
+  std::ofstream file(path.c_str());
+  CHECK(file.good()) << "Cannot write " << path;
+
+  boost::mutex::scoped_lock lock(mutex_);
+  file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  for (size_t i = 0; i < events_.size(); i++)
+  {
+    const tEvent& event = events_[i];
+    file << "{\"name\": \"" << Escape(event.name) << "\", \"cat\": \"" << event.category << "\", \"ph\": \"X\""
+         << ", \"ts\": " << event.start << ", \"dur\": " << event.duration
+         << ", \"pid\": 1, \"tid\": " << event.thread;
+    if (event.flops > 0)
+    {
+      file << ", \"args\": {\"flops\": " << event.flops << "}";
+    }
+    file << "}" << (i + 1 < events_.size() ? ",\n" : "\n");
+  }
+  file << "]}" << std::endl;
+  CHECK(file.good()) << "Cannot write " << path;
+}
+
+void
+Profiler::PrintSummary(std::ostream& out) const
+{
+  std::vector<tTotal> totals;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    totals = totals_;
+  }
+  boost::int64_t iTotalDuration = 0;
+  for (size_t i = 0; i < totals.size(); i++)
+  {
+    iTotalDuration += totals[i].duration;
+  }
+  std::stable_sort(totals.begin(), totals.end(), MoreDuration);
+
+  const std::ios::fmtflags flags = out.flags();
+  const std::streamsize precision = out.precision();
+  out << std::fixed << std::setprecision(3);
+  out << std::left << std::setw(32) << "layer / stage" << std::right
+      << std::setw(10) << "calls" << std::setw(12) << "total ms" << std::setw(12) << "mean ms"
+      << std::setw(8) << "%" << std::setw(12) << "MFLOP" << std::setw(12) << "GFLOP/s" << std::endl;
+  for (size_t i = 0; i < totals.size(); i++)
+  {
+    const tTotal& total = totals[i];
+    const double dMs = total.duration / 1000.0;
+    out << std::left << std::setw(32) << total.name << std::right
+        << std::setw(10) << total.calls
+        << std::setw(12) << dMs
+        << std::setw(12) << dMs / total.calls
+        << std::setw(8) << (iTotalDuration > 0 ? 100.0 * total.duration / iTotalDuration : 0)
+        << std::setw(12) << total.flops / 1e6
+        << std::setw(12) << (total.duration > 0 ? total.flops / total.duration / 1e3 : 0) << std::endl;
+  }
+  out.flags(flags);
+  out.precision(precision);
+}
+
+void
+Profiler::Write(const std::string& path, std::ostream& log) const
+{
+  WriteTrace(path);
+  log << "wrote trace " << path << std::endl;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (dropped_ > 0)
+    {
+      log << "the trace holds the first " << events_.size() << " events, " << dropped_ << " later events are only in the summary" << std::endl;
+    }
+  }
+  PrintSummary(log);
+}
+
+double
+Profiler::LayerFlops(const caffe::Net<float>& net, const int i)
+{
+  caffe::Layer<float>& layer = *net.layers()[i];
+  const std::vector<caffe::Blob<float>*>& top = net.top_vecs()[i];
+  if (top.empty())
+  {
+    return 0;
+  }
+  const std::string sType = layer.type();
+  if (sType == "Input")
+  {
+    return 0;
+  }
+  if ((sType == "InnerProduct" || sType == "Convolution") && !layer.blobs().empty())
+  {
+    // a multiply and an add for every weight of an output value
+    const caffe::Blob<float>& weights = *layer.blobs()[0];
+    return 2.0 * top[0]->count() * (weights.count() / weights.shape(0));
+  }
+  // an element wise layer, like Sigmoid, ReLU or Softmax, takes about one operation per value
+  return top[0]->count();
+}
@@ -0,0 +1,115 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#ifndef COMMON_PROFILER_HPP_
+#define COMMON_PROFILER_HPP_
+
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+#include <caffe/caffe.hpp>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Records how long the layers of a net and the stages of a tool take, from any number
+// of threads. The layers are run one at a time with Net::ForwardFromTo and every layer
+// also records its number of floating point operations for the shape of its input.
+// The recordings can be written as a trace in the Chrome trace event format (for
+// chrome://tracing or Perfetto) and summarized per layer and stage in a table.
+// The trace keeps the first kMaxEvents events, so a server that runs for a long time
+// doesn't run out of memory; the summary counts all of them.
+class Profiler
+{
+public:
+  // Records stages of a thread that follow each other; Start ends the running stage and
+  // starts the next one. It does nothing without a profiler.
+  class Stage
+  {
+  public:
+    explicit Stage(Profiler* profiler);
+
+    // stops the running stage
+    ~Stage();
+
+    // starts stage name, which must stay valid while the profiler is used
+    void Start(const char* name);
+    void Stop();
+
+  private:
+    Profiler* profiler_;
+    const char* name_;
+    boost::int64_t start_;
+  };
+
+  Profiler();
+
+  // Runs the layers [start, end] of net one at a time and records each of them
+  void ForwardFromTo(caffe::Net<float>* net, const int start, const int end);
+
+  // runs the layers from start to the last one
+  void ForwardFrom(caffe::Net<float>* net, const int start);
+
+  // Records an event of category that took place from start to end (us since the
+  // construction of the profiler) on the calling thread
+  void Record(const std::string& name, const std::string& category,
+              const boost::int64_t start, const boost::int64_t end, const double flops);
+
+  // us since the construction of the profiler
+  boost::int64_t Now() const;
+
+  // writes the kept events as a Chrome trace (JSON) to path
+  void WriteTrace(const std::string& path) const;
+
+  // Writes a table with the number of calls, the total and mean time, the share of the
+  // total time and the FLOPs of every layer and stage to out, the most expensive first
+  void PrintSummary(std::ostream& out) const;
+
+  // writes the trace to path and prints where it went and the summary to log
+  void Write(const std::string& path, std::ostream& log) const;
+
+  // number of floating point operations of layer i of net for its current shape
+  static double LayerFlops(const caffe::Net<float>& net, const int i);
+
+private:
+  // events kept for the trace, about 100 MB
+  static const size_t kMaxEvents = 1000000;
+
+  struct tEvent
+  {
+    std::string name;
+    std::string category;
+    int thread;
+    boost::int64_t start;
+    boost::int64_t duration;
+    double flops;
+  };
+
+  // summed events of a layer or stage
+  struct tTotal
+  {
+    tTotal() : calls(0), duration(0), flops(0) {}
+
+    std::string name;
+    std::string category;
+    long calls;
+    boost::int64_t duration;
+    double flops;
+  };
+
+  static bool MoreDuration(const tTotal& a, const tTotal& b);
+
+  const boost::posix_time::ptime start_;
+  mutable boost::mutex mutex_;
+  std::vector<tEvent> events_;
+  long dropped_; // events that didn't fit in the trace
+  std::vector<tTotal> totals_;
+  std::map<std::string, size_t> total_index_; // category/name to its total
+  std::map<boost::thread::id, int> threads_; // small number of every thread for the trace
+};
+
+#endif // COMMON_PROFILER_HPP_
@@ -0,0 +1,319 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#include "quantized-mlp.hpp"
+
+#include <algorithm>
+#include <caffe/util/math_functions.hpp>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+
+// range and resolution of the sigmoid table, outside the range the sigmoid is 0 or 1 within 0.0004
+const float kSigmoidRange = 8.0f;
+const int kSigmoidStepsPerUnit = 256;
+
+// converts to an IEEE half precision float, rounding to the nearest
+unsigned short
+FloatToHalf(const float value)
+{
+  unsigned int f;
+  std::memcpy(&f, &value, sizeof(f));
+  const unsigned int sign = (f >> 16) & 0x8000;
+  const int exponent = static_cast<int>((f >> 23) & 0xff) - 127 + 15;
+  unsigned int mantissa = f & 0x7fffff;
+
+  // infinity and nan
+  if (((f >> 23) & 0xff) == 0xff)
+  {
+    return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+  }
+  // too large
+  if (exponent >= 31)
+  {
+    return sign | 0x7c00;
+  }
+  // too small for a normal half, becomes subnormal or zero
+  if (exponent <= 0)
+  {
+    if (exponent < -10)
+    {
+      return sign;
+    }
+    mantissa |= 0x800000;
+    const int shift = 14 - exponent;
+    unsigned int half = mantissa >> shift;
+    const unsigned int rest = mantissa & ((1u << shift) - 1);
+    const unsigned int halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1)))
+    {
+      half++;
+    }
+    return sign | half;
+  }
+
+  // a carry of the rounding goes into the exponent, which is still correct
+  unsigned int half = (exponent << 10) | (mantissa >> 13);
+  const unsigned int rest = mantissa & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+  {
+    half++;
+  }
+  return sign | half;
+}
+
+// converts an IEEE half precision float
+float
+HalfToFloat(const unsigned short half)
+{
+  const unsigned int sign = static_cast<unsigned int>(half & 0x8000) << 16;
+  const unsigned int exponent = (half >> 10) & 0x1f;
+  const unsigned int mantissa = half & 0x3ff;
+
+  // zero and subnormal
+  if (exponent == 0)
+  {
+    const float value = std::ldexp(static_cast<float>(mantissa), -24);
+    return sign ? -value : value;
+  }
+
+  unsigned int f;
+  if (exponent == 31)
+  {
+    f = sign | 0x7f800000 | (mantissa << 13);
+  }
+  else
+  {
+    f = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  float value;
+  std::memcpy(&value, &f, sizeof(value));
+  return value;
+}
+
+} // namespace
+
+bool
+QuantizedMlp::ParsePrecision(const std::string& name, tPrecision* precision)
+{
+  if (name == "fp16")
+  {
+    *precision = kFp16;
+    return true;
+  }
+  if (name == "int8")
+  {
+    *precision = kInt8;
+    return true;
+  }
+  return false;
+}
+
+QuantizedMlp::QuantizedMlp(const caffe::Net<float>& net, const tPrecision precision)
+  : precision_(precision)
+  , softmax_(false)
+{
+  const std::vector<boost::shared_ptr<caffe::Layer<float> > >& layers = net.layers();
+  for (size_t i = 0; i < layers.size(); i++)
+  {
+    const std::string type = layers[i]->type();
+    const std::string& name = layers[i]->layer_param().name();
+    CHECK(!softmax_) << "Layer " << name << " follows the Softmax layer";
+    if (type == "InnerProduct")
+    {
+      const std::vector<boost::shared_ptr<caffe::Blob<float> > >& blobs = layers[i]->blobs();
+      tLayer layer;
+      layer.outputs = blobs[0]->shape(0);
+      layer.inputs = blobs[0]->count() / layer.outputs;
+      layer.activation = kNone;
+      CHECK(layers_.empty() || layers_.back().outputs == layer.inputs) << "Layer " << name << " doesn't fit its input";
+
+      // calibrate the scale of the layer from its largest absolute weight
+      const float* pWeights = blobs[0]->cpu_data();
+      const int iCount = blobs[0]->count();
+      float max = 0;
+      for (int j = 0; j < iCount; j++)
+      {
+        max = std::max(max, std::fabs(pWeights[j]));
+      }
+      layer.weight_scale = (max > 0) ? max / 127 : 1;
+
+      if (precision_ == kFp16)
+      {
+        layer.half_weights.resize(iCount);
+        for (int j = 0; j < iCount; j++)
+        {
+          layer.half_weights[j] = HalfToFloat(FloatToHalf(pWeights[j]));
+        }
+      }
+      else
+      {
+        layer.int8_weights.resize(iCount);
+        for (int j = 0; j < iCount; j++)
+        {
+          layer.int8_weights[j] = static_cast<signed char>(std::floor(pWeights[j] / layer.weight_scale + 0.5f));
+        }
+      }
+
+      if (blobs.size() > 1)
+      {
+        layer.bias.assign(blobs[1]->cpu_data(), blobs[1]->cpu_data() + layer.outputs);
+      }
+      else
+      {
+        layer.bias.assign(layer.outputs, 0.0f);
+      }
+      layers_.push_back(layer);
+    }
+    else if (type == "Sigmoid" || type == "ReLU")
+    {
+      CHECK(!layers_.empty() && layers_.back().activation == kNone) << "Layer " << name << " must follow an InnerProduct layer";
+      layers_.back().activation = (type == "Sigmoid") ? kSigmoid : kReLU;
+    }
+    else if (type == "Softmax")
+    {
+      softmax_ = true;
+    }
+    else if (type != "Input")
+    {
+      LOG(FATAL) << "Layer " << name << " of type " << type << " can't be run with reduced precision";
+    }
+  }
+  CHECK(!layers_.empty()) << "The net has no InnerProduct layers";
+
+  // sample the sigmoid
+  const int iSteps = static_cast<int>(2 * kSigmoidRange * kSigmoidStepsPerUnit);
+  sigmoid_table_.resize(iSteps + 1);
+  for (int i = 0; i <= iSteps; i++)
+  {
+    const float x = -kSigmoidRange + static_cast<float>(i) / kSigmoidStepsPerUnit;
+    sigmoid_table_[i] = 1.0f / (1.0f + std::exp(-x));
+  }
+}
+
+float
+QuantizedMlp::Sigmoid(const float x) const
+{
+  const float index = (std::min(std::max(x, -kSigmoidRange), kSigmoidRange) + kSigmoidRange) * kSigmoidStepsPerUnit;
+  return sigmoid_table_[static_cast<int>(index + 0.5f)];
+}
+
+void
+QuantizedMlp::Forward(const float* input, const int num, float* output)
+{
+  // the layers in between write to one buffer and read from the other
+  const float* pInput = input;
+  for (size_t i = 0; i < layers_.size(); i++)
+  {
+    float* pOutput = output;
+    if (i + 1 < layers_.size())
+    {
+      std::vector<float>& buffer = buffers_[i % 2];
+      buffer.resize(num * layers_[i].outputs);
+      pOutput = &buffer[0];
+    }
+    ForwardLayer(layers_[i], pInput, num, pOutput);
+    pInput = pOutput;
+  }
+
+  if (softmax_)
+  {
+    const int iOutputs = output_size();
+    for (int n = 0; n < num; n++)
+    {
+      float* pValues = output + n * iOutputs;
+      const float max = *std::max_element(pValues, pValues + iOutputs);
+      float sum = 0;
+      for (int j = 0; j < iOutputs; j++)
+      {
+        pValues[j] = std::exp(pValues[j] - max);
+        sum += pValues[j];
+      }
+      for (int j = 0; j < iOutputs; j++)
+      {
+        pValues[j] /= sum;
+      }
+    }
+  }
+}
+
+void
+QuantizedMlp::ForwardLayer(const tLayer& layer, const float* input, const int num, float* output)
+{
+  const int iInputs = layer.inputs;
+  const int iOutputs = layer.outputs;
+
+  if (precision_ == kFp16)
+  {
+    // output = input * weights^T + bias, like Caffe's InnerProduct layer
+    caffe::caffe_cpu_gemm<float>(CblasNoTrans, CblasTrans, num, iOutputs, iInputs, 1.0f,
+                                 input, &layer.half_weights[0], 0.0f, output);
+    for (int n = 0; n < num; n++)
+    {
+      float* pOutput = output + n * iOutputs;
+      for (int o = 0; o < iOutputs; o++)
+      {
+        pOutput[o] += layer.bias[o];
+      }
+    }
+  }
+  else
+  {
+    // quantize every input with the scale of its largest absolute value
+    quantized_.resize(num * iInputs);
+    input_scales_.resize(num);
+    for (int n = 0; n < num; n++)
+    {
+      const float* pInput = input + n * iInputs;
+      float max = 0;
+      for (int i = 0; i < iInputs; i++)
+      {
+        max = std::max(max, std::fabs(pInput[i]));
+      }
+      input_scales_[n] = (max > 0) ? max / 127 : 1;
+      const float inverse_scale = 1 / input_scales_[n];
+      signed char* pQuantized = &quantized_[n * iInputs];
+      for (int i = 0; i < iInputs; i++)
+      {
+        pQuantized[i] = static_cast<signed char>(std::floor(pInput[i] * inverse_scale + 0.5f));
+      }
+    }
+
+    for (int o = 0; o < iOutputs; o++)
+    {
+      const signed char* pRow = &layer.int8_weights[o * iInputs];
+      for (int n = 0; n < num; n++)
+      {
+        const signed char* pInput = &quantized_[n * iInputs];
+        int sum = 0;
+        for (int i = 0; i < iInputs; i++)
+        {
+          sum += pRow[i] * pInput[i];
+        }
+        output[n * iOutputs + o] = sum * layer.weight_scale * input_scales_[n] + layer.bias[o];
+      }
+    }
+  }
+
+  // activation
+  const int iCount = num * iOutputs;
+  if (layer.activation == kSigmoid)
+  {
+    for (int i = 0; i < iCount; i++)
+    {
+      output[i] = Sigmoid(output[i]);
+    }
+  }
+  else if (layer.activation == kReLU)
+  {
+    for (int i = 0; i < iCount; i++)
+    {
+      output[i] = std::max(output[i], 0.0f);
+    }
+  }
+}
@@ -0,0 +1,71 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#ifndef COMMON_QUANTIZED_MLP_HPP_
+#define COMMON_QUANTIZED_MLP_HPP_
+
+#include <caffe/caffe.hpp>
+#include <string>
+#include <vector>
+
+// Runs a net that is a stack of InnerProduct layers, each optionally followed by a Sigmoid
+// or ReLU layer, and optionally a final Softmax layer, with reduced precision weights:
+// - fp16: the weights are rounded to half precision floats and converted back once, the
+//   layers are single precision matrix products (Caffe's gemm) with the rounded weights.
+// - int8: the weights of a layer are quantized with a single scale, calibrated from the
+//   trained model so the largest absolute weight becomes 127. Every input of a layer is
+//   quantized with a scale of its own, so an output doesn't depend on the other inputs of
+//   the batch, and the products are summed as integers.
+// The sigmoid is looked up in a table.
+// Forward uses buffers of the object, so every thread needs its own.
+class QuantizedMlp
+{
+public:
+  enum tPrecision {kFp16, kInt8};
+
+  // Sets precision and returns true when name is fp16 or int8
+  static bool ParsePrecision(const std::string& name, tPrecision* precision);
+
+  // takes the trained weights of net, which may only have the layers described above
+  QuantizedMlp(const caffe::Net<float>& net, const tPrecision precision);
+
+  // number of values of one input and one output
+  int input_size() const { return layers_.front().inputs; }
+  int output_size() const { return layers_.back().outputs; }
+
+  // Computes the output of the net for num inputs, one after another in input and output
+  void Forward(const float* input, const int num, float* output);
+
+private:
+  enum tActivation {kNone, kSigmoid, kReLU};
+
+  struct tLayer
+  {
+    int inputs;
+    int outputs;
+    std::vector<float> half_weights;       // weights rounded to fp16, outputs x inputs
+    std::vector<signed char> int8_weights; // int8 weights, outputs x inputs
+    float weight_scale;                       // int8 weight = weight / weight_scale
+    std::vector<float> bias;
+    tActivation activation;
+  };
+
+  // computes the output of layer for num inputs
+  void ForwardLayer(const tLayer& layer, const float* input, const int num, float* output);
+
+  // table lookup of the sigmoid
+  float Sigmoid(const float x) const;
+
+  tPrecision precision_;
+  bool softmax_;
+  std::vector<tLayer> layers_;
+  std::vector<float> buffers_[2];      // input and output of the layers in between
+  std::vector<signed char> quantized_; // quantized input of a layer
+  std::vector<float> input_scales_;    // scale of every quantized input
+  std::vector<float> sigmoid_table_;
+};
+
+#endif // COMMON_QUANTIZED_MLP_HPP_
@@ -0,0 +1,336 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#include "sample-writer.hpp"
+
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+
+// FNV-1a hash of a key, the same on every platform so a sample always goes to the same shard
+unsigned int
+HashKey(const char* key, const int length)
+{
+  unsigned int uHash = 2166136261u;
+  for (int i = 0; i < length; i++)
+  {
+    uHash ^= static_cast<unsigned char>(key[i]);
+    uHash *= 16777619u;
+  }
+  return uHash;
+}
+
+} // namespace
+
+SampleWriter::tShard::tShard(const std::string& backend, const std::string& name, const size_t queue_size)
+  : name(name)
+  , key(kKeyLength, '0')
+  , db(caffe::db::GetDB(backend))
+  , queue(queue_size)
+  , count(0)
+  , bytes(0)
+  , commits(0)
+  , seconds(0)
+  , pending_count(0)
+  , pending_bytes(0)
+{
+  db->Open(name, caffe::db::NEW);
+}
+
+SampleWriter::SampleWriter(const std::string& backend,
+                           const std::string& name,
+                           const int split,
+                           const int shards,
+                           const size_t queue_size,
+                           const int commit_samples,
+                           const size_t commit_bytes)
+  : backend_(backend)
+  , name_(name)
+  , split_(split)
+  , commit_samples_(commit_samples)
+  , commit_bytes_(commit_bytes)
+  , count_(0)
+  , put_to_train_(0)
+  , put_to_test_(0)
+  , next_to_test_(false) // always start with train samples
+  , closed_(false)
+  , seconds_(0)
+{
+  CHECK_GE(shards, 1);
+  timer_.Start();
+
+  // Create new train and test DB, the queue size is divided over the shards
+  const size_t shard_queue_size = queue_size / (2 * shards) + 1;
+  Open(backend, name + "_train", shards, shard_queue_size, &train_);
+  Open(backend, name + "_test", shards, shard_queue_size, &test_);
+}
+
+SampleWriter::~SampleWriter()
+{
+  Close();
+}
+
+void
+SampleWriter::Open(const std::string& backend, const std::string& name, const int shards,
+                   const size_t queue_size, tShards* split)
+{
+  for (int i = 0; i < shards; i++)
+  {
+    std::stringstream ss;
+    ss << name;
+    if (shards > 1)
+    {
+      ss << "_" << i;
+    }
+    boost::shared_ptr<tShard> shard(new tShard(backend, ss.str(), queue_size));
+    shard->thread = boost::thread(boost::bind(&SampleWriter::Run, this, shard.get()));
+    split->push_back(shard);
+  }
+}
+
+void
+SampleWriter::Put(const std::string& value, const int label)
+{
+  // write datum to db use the sample number as key for db
+  tSample sample;
+  FormatKey(count_, sample.key);
+  sample.value = value;
+  sample.label = label;
+  count_++;
+
+  // put sample in the shard of its key
+  tShards& split = next_to_test_ ? test_ : train_;
+  split[HashKey(sample.key, kKeyLength) % split.size()]->queue.Push(sample);
+  if (next_to_test_)
+  {
+    put_to_test_++;
+  }
+  else
+  {
+    put_to_train_++;
+  }
+
+  // determine where next sample should go
+  if (split_ == 0)
+  {
+    next_to_test_ = false;
+  }
+  else if (split_ < 0)
+  {
+    if (put_to_test_ == std::abs(split_))
+    {
+      next_to_test_ = false;
+      put_to_test_ = 0;
+    }
+    else
+    {
+      next_to_test_ = true;
+    }
+  }
+  else if (split_ > 0)
+  {
+    if (put_to_train_ == split_)
+    {
+      next_to_test_ = true;
+      put_to_train_ = 0;
+    }
+    else
+    {
+      next_to_test_ = false;
+    }
+  }
+}
+
+void
+SampleWriter::Close()
+{
+  if (closed_)
+  {
+    return;
+  }
+  closed_ = true;
+
+  for (size_t i = 0; i < train_.size(); i++)
+  {
+    train_[i]->queue.Close();
+    test_[i]->queue.Close();
+  }
+  for (size_t i = 0; i < train_.size(); i++)
+  {
+    train_[i]->thread.join();
+    test_[i]->thread.join();
+  }
+
+  // a single database per split needs no description
+  if (train_.size() > 1)
+  {
+    WriteManifest(name_ + "_train", train_);
+    WriteManifest(name_ + "_test", test_);
+  }
+
+  seconds_ = timer_.Seconds();
+}
+
+int
+SampleWriter::count_train() const
+{
+  int iCount = 0;
+  for (size_t i = 0; i < train_.size(); i++)
+  {
+    iCount += train_[i]->count;
+  }
+  return iCount;
+}
+
+int
+SampleWriter::count_test() const
+{
+  int iCount = 0;
+  for (size_t i = 0; i < test_.size(); i++)
+  {
+    iCount += test_[i]->count;
+  }
+  return iCount;
+}
+
+size_t
+SampleWriter::bytes() const
+{
+  size_t iBytes = 0;
+  for (size_t i = 0; i < train_.size(); i++)
+  {
+    iBytes += train_[i]->bytes + test_[i]->bytes;
+  }
+  return iBytes;
+}
+
+int
+SampleWriter::commits() const
+{
+  int iCommits = 0;
+  for (size_t i = 0; i < train_.size(); i++)
+  {
+    iCommits += train_[i]->commits + test_[i]->commits;
+  }
+  return iCommits;
+}
+
+double
+SampleWriter::write_seconds() const
+{
+  double dSeconds = 0;
+  for (size_t i = 0; i < train_.size(); i++)
+  {
+    dSeconds = std::max(dSeconds, std::max(train_[i]->seconds, test_[i]->seconds));
+  }
+  return dSeconds;
+}
+
+void
+SampleWriter::Run(tShard* shard)
+{
+  // a write transaction belongs to the thread that begins it (lmdb), so all of them are
+  // begun by the writer thread
+  shard->txn.reset(shard->db->NewTransaction());
+
+  // only the writing is timed, not the wait for samples
+  caffe::CPUTimer timer;
+  tSample sample;
+  while (shard->queue.Pop(&sample))
+  {
+    timer.Start();
+    Write(shard, sample);
+    shard->seconds += timer.Seconds();
+  }
+
+  // commit the last unwritten batch
+  timer.Start();
+  Commit(shard);
+  shard->seconds += timer.Seconds();
+  shard->txn.reset();
+  shard->db->Close();
+}
+
+void
+SampleWriter::FormatKey(int i, char* key)
+{
+  for (int iDigit = kKeyLength - 1; iDigit >= 0; iDigit--)
+  {
+    key[iDigit] = static_cast<char>('0' + i % 10);
+    i /= 10;
+  }
+}
+
+void
+SampleWriter::Write(tShard* shard, const tSample& sample)
+{
+  shard->key.assign(sample.key, kKeyLength);
+  shard->txn->Put(shard->key, sample.value);
+  shard->count++;
+  shard->classes[sample.label]++;
+  shard->pending_count++;
+  shard->pending_bytes += kKeyLength + sample.value.size();
+
+  // commit when the transaction is full
+  if ((commit_samples_ > 0 && shard->pending_count >= commit_samples_) ||
+      (commit_bytes_ > 0 && shard->pending_bytes >= commit_bytes_))
+  {
+    Commit(shard);
+  }
+}
+
+void
+SampleWriter::Commit(tShard* shard)
+{
+  if (shard->pending_count == 0)
+  {
+    return;
+  }
+  shard->txn->Commit();
+  shard->txn.reset(shard->db->NewTransaction());
+  shard->bytes += shard->pending_bytes;
+  shard->commits++;
+  shard->pending_count = 0;
+  shard->pending_bytes = 0;
+}
+
+void
+SampleWriter::WriteManifest(const std::string& name, const tShards& split) const
+{
+  std::ofstream file((name + ".json").c_str());
+  CHECK(file) << "Failed to open manifest " << name << ".json";
+
+  int iCount = 0;
+  for (size_t i = 0; i < split.size(); i++)
+  {
+    iCount += split[i]->count;
+  }
+
+  file << "{" << std::endl;
+  file << "  \"backend\": \"" << backend_ << "\"," << std::endl;
+  file << "  \"count\": " << iCount << "," << std::endl;
+  file << "  \"shards\": [" << std::endl;
+  for (size_t i = 0; i < split.size(); i++)
+  {
+    const tShard& shard = *split[i];
+    file << "    {\"name\": \"" << shard.name << "\", \"count\": " << shard.count
+         << ", \"bytes\": " << shard.bytes << ", \"classes\": {";
+    for (std::map<int, int>::const_iterator itr = shard.classes.begin()
+                                          ; itr != shard.classes.end()
+                                          ; ++itr)
+    {
+      file << (itr == shard.classes.begin() ? "" : ", ") << "\"" << itr->first << "\": " << itr->second;
+    }
+    file << "}}" << (i + 1 < split.size() ? "," : "") << std::endl;
+  }
+  file << "  ]" << std::endl;
+  file << "}" << std::endl;
+}
@@ -0,0 +1,139 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#ifndef COMMON_SAMPLE_WRITER_HPP_
+#define COMMON_SAMPLE_WRITER_HPP_
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <caffe/util/benchmark.hpp>
+#include <caffe/util/db.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "bounded-queue.hpp"
+
+// Writes serialized samples (caffe::Datum) to a TRAIN database NAME_train and a TEST
+// database NAME_test, so generating samples and writing them overlap.
+// The samples are divided over TRAIN and TEST by the split rate; that number of samples
+// goes to TRAIN before one goes to TEST, a negative number does the opposite and 0 puts
+// all samples in TRAIN.
+// With more than one shard every split is written to that number of databases
+// NAME_train_0, NAME_train_1, ... by a thread per database, a sample goes to the shard
+// selected by the hash of its key, and NAME_train.json and NAME_test.json describe the
+// databases of a split with their number of samples and classes.
+// Keys are the sample numbers as zero padded decimals of fixed width, so they sort in the
+// order the samples are put and the databases are filled sequentially.
+// A transaction is committed once it holds commit_samples samples or commit_bytes bytes,
+// whichever comes first (0 disables that limit).
+class SampleWriter
+{
+public:
+  SampleWriter(const std::string& backend,
+               const std::string& name,
+               const int split,
+               const int shards,
+               const size_t queue_size,
+               const int commit_samples,
+               const size_t commit_bytes);
+
+  // closes when that wasn't done yet
+  ~SampleWriter();
+
+  // Queues a sample with its label for writing, waits while the queue is full
+  void Put(const std::string& value, const int label);
+
+  // Writes all queued samples, waits until they are committed and writes the manifests of
+  // the shards
+  void Close();
+
+  // number of written samples, valid after Close()
+  int count() const { return count_train() + count_test(); }
+  int count_train() const;
+  int count_test() const;
+
+  // number of written bytes (keys and values) and commits, valid after Close()
+  size_t bytes() const;
+  int commits() const;
+
+  // end-to-end time from construction until everything was written, including generating
+  // the samples, valid after Close()
+  double seconds() const { return seconds_; }
+
+  // time the busiest writer thread spent putting and committing samples, the databases are
+  // written in parallel so bytes() / write_seconds() is their write rate, valid after Close()
+  double write_seconds() const;
+
+private:
+  // number of digits of a key, enough for any int
+  static const int kKeyLength = 10;
+
+  struct tSample
+  {
+    char key[kKeyLength];
+    std::string value;
+    int label;
+  };
+
+  // a database with the transaction that is being filled and its writer thread
+  struct tShard
+  {
+    tShard(const std::string& backend, const std::string& name, const size_t queue_size);
+
+    std::string name;
+    std::string key; // reused key buffer
+    boost::scoped_ptr<caffe::db::DB> db;
+    boost::scoped_ptr<caffe::db::Transaction> txn;
+    BoundedQueue<tSample> queue;
+    boost::thread thread;
+    int count;                // samples put
+    size_t bytes;             // bytes put
+    int commits;              // transactions committed
+    double seconds;           // time spent putting and committing
+    int pending_count;        // samples in the current transaction
+    size_t pending_bytes;     // bytes in the current transaction
+    std::map<int, int> classes; // samples per label
+  };
+  typedef std::vector<boost::shared_ptr<tShard> > tShards;
+
+  // creates the shards of a split
+  void Open(const std::string& backend, const std::string& name, const int shards,
+            const size_t queue_size, tShards* split);
+
+  // writer thread of a shard
+  void Run(tShard* shard);
+
+  // key of the sample with number i
+  static void FormatKey(int i, char* key);
+
+  // puts a sample in the transaction of shard and commits it when it is full
+  void Write(tShard* shard, const tSample& sample);
+
+  // commits the transaction of shard when it holds any samples
+  void Commit(tShard* shard);
+
+  // describes the shards of a split as json
+  void WriteManifest(const std::string& name, const tShards& split) const;
+
+  const std::string backend_;
+  const std::string name_;
+  const int split_;
+  const int commit_samples_;
+  const size_t commit_bytes_;
+  tShards train_;
+  tShards test_;
+  int count_;
+  int put_to_train_;
+  int put_to_test_;
+  bool next_to_test_;
+  bool closed_;
+  caffe::CPUTimer timer_;
+  double seconds_;
+};
+
+#endif // COMMON_SAMPLE_WRITER_HPP_
@@ -0,0 +1,69 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#ifndef COMMON_SHUFFLE_BUFFER_HPP_
+#define COMMON_SHUFFLE_BUFFER_HPP_
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Shuffles a stream of items of unknown length with bounded memory.
+// The buffer holds at most capacity items; once it is full every new item takes the
+// place of a random item in the buffer, which is returned. When all items fit in the
+// buffer the order is completely random, like std::random_shuffle.
+template <typename T>
+class ShuffleBuffer
+{
+public:
+  ShuffleBuffer(const size_t capacity, const unsigned int seed)
+    : capacity_(capacity > 0 ? capacity : 1)
+    , rng_(seed)
+  {
+  }
+
+  // Adds item to the buffer. Returns true and puts a random item from the buffer in out
+  // when the buffer was full.
+  bool Add(const T& item, T* out)
+  {
+    if (buffer_.size() < capacity_)
+    {
+      buffer_.push_back(item);
+      return false;
+    }
+    const size_t i = Random(buffer_.size());
+    *out = buffer_[i];
+    buffer_[i] = item;
+    return true;
+  }
+
+  // Takes the remaining items out of the buffer in random order
+  void Flush(std::vector<T>* out)
+  {
+    for (size_t i = buffer_.size(); i > 1; i--)
+    {
+      std::swap(buffer_[i - 1], buffer_[Random(i)]);
+    }
+    out->swap(buffer_);
+    buffer_.clear();
+  }
+
+private:
+  // random index in [0, n)
+  size_t Random(const size_t n)
+  {
+    boost::random::uniform_int_distribution<size_t> distribution(0, n - 1);
+    return distribution(rng_);
+  }
+
+  std::vector<T> buffer_;
+  const size_t capacity_;
+  boost::mt19937 rng_;
+};
+
+#endif // COMMON_SHUFFLE_BUFFER_HPP_
@@ -0,0 +1,72 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#include "train-in-memory.hpp"
+
+#include <gflags/gflags.h>
+#include <caffe/caffe.hpp>
+#include <caffe/util/benchmark.hpp>
+#include <boost/shared_ptr.hpp>
+#include <ctime>
+#include <sstream>
+
+// define gflags FLAGS and default values
+DEFINE_int32(threads, 1, "Number of threads {nr} that generate samples");
+DEFINE_int32(prefetch, 10000, "Number of generated samples {nr} that can wait to be trained with");
+DEFINE_int32(shuffle_buffer, 1000, "Number of samples {nr} kept in memory for shuffling, the samples that are generated together are spread over this many samples");
+DEFINE_int32(seed, -1, "Seed {nr} for the random generators; use a negative value to seed with the current time");
+DEFINE_string(snapshot, "", "Solver state to resume training from");
+
+int
+TrainInMemory(int argc, char* argv[], const std::string& tool,
+              const MemoryFeed::tGenerator& generator, const int sample_size,
+              const int shuffle_samples)
+{
+  ::google::InitGoogleLogging(argv[0]);
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  std::ostringstream shuffle_default;
+  shuffle_default << shuffle_samples;
+  gflags::SetCommandLineOptionWithMode("shuffle_buffer", shuffle_default.str().c_str(), gflags::SET_FLAGS_DEFAULT);
+  gflags::SetUsageMessage("Trains the net of a solver with random samples that are generated while it trains\n"
+                          "Usage:\n"
+                          " " + tool + " [FLAGS] SOLVER\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 2 || FLAGS_threads < 1 || FLAGS_prefetch < 1)
+  {
+    // the flags of this file and of the tool (train-xor.cpp, train-shape.cpp)
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "train-");
+    return 1;
+  }
+
+  // seed random generators
+  const unsigned int seed = (FLAGS_seed < 0) ? static_cast<unsigned int>(std::time(NULL)) : FLAGS_seed;
+  std::cout << "seed: " << seed << std::endl;
+
+  // the Data layers of the net get their samples from memory
+  caffe::SolverParameter solver_param;
+  MemoryFeed::ReadSolverParameter(argv[1], sample_size, &solver_param);
+  caffe::Caffe::set_mode(solver_param.solver_mode() == caffe::SolverParameter_SolverMode_GPU ? caffe::Caffe::GPU : caffe::Caffe::CPU);
+
+  // the samples are generated while the solver trains
+  MemoryFeed feed(generator, sample_size, FLAGS_threads, FLAGS_prefetch, FLAGS_shuffle_buffer, seed);
+  boost::shared_ptr<caffe::Solver<float> > solver(caffe::SolverRegistry<float>::CreateSolver(solver_param));
+  feed.Attach(solver.get());
+
+  caffe::CPUTimer timer;
+  timer.Start();
+  solver->Solve(FLAGS_snapshot.empty() ? NULL : FLAGS_snapshot.c_str());
+  const double dSeconds = timer.Seconds();
+
+  std::cout << "trained " << solver->iter() << " iterations in " << dSeconds << " seconds with "
+            << feed.taken() << " generated samples (" << (dSeconds > 0 ? feed.taken() / dSeconds : 0) << " samples/s), "
+            << feed.wait_seconds() << " seconds spent taking samples" << std::endl;
+  return 0;
+}
@@ -0,0 +1,23 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#ifndef COMMON_TRAIN_IN_MEMORY_HPP_
+#define COMMON_TRAIN_IN_MEMORY_HPP_
+
+#include <string>
+
+#include "memory-feed.hpp"
+
+// Runs a tool that trains the net of a solver with samples of sample_size values that
+// generator makes while it trains (see MemoryFeed), instead of samples read from a
+// database. It takes the command line "tool [FLAGS] SOLVER" with the flags --threads,
+// --prefetch, --shuffle_buffer (shuffle_samples by default), --seed and --snapshot, and
+// the flags of the tool itself. Returns the exit code of the tool.
+int TrainInMemory(int argc, char* argv[], const std::string& tool,
+                  const MemoryFeed::tGenerator& generator, const int sample_size,
+                  const int shuffle_samples);
+
+#endif // COMMON_TRAIN_IN_MEMORY_HPP_
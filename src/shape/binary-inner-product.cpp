@@ -0,0 +1,96 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#include "binary-inner-product.hpp"
+
+#include <algorithm>
+#include <string>
+
+namespace
+{
+
+// index of the lowest set bit of a word that is not 0
+inline int
+LowestBit(const boost::uint64_t word)
+{
+#ifdef __GNUC__
+  return __builtin_ctzll(word);
+#else
+  int i = 0;
+  while (((word >> i) & 1) == 0)
+  {
+    i++;
+  }
+  return i;
+#endif
+}
+
+} // namespace
+
+BinaryInnerProduct::BinaryInnerProduct(const caffe::Net<float>& net)
+  : layer_(-1)
+  , inputs_(0)
+  , outputs_(0)
+{
+  // the first layer after the input
+  const std::vector<boost::shared_ptr<caffe::Layer<float> > >& layers = net.layers();
+  for (size_t i = 0; i < layers.size() && layer_ < 0; i++)
+  {
+    const std::string type = layers[i]->type();
+    if (type == "InnerProduct")
+    {
+      layer_ = i;
+    }
+    else
+    {
+      CHECK_EQ(type, "Input") << "The first layer of the net must be an InnerProduct layer";
+    }
+  }
+  CHECK_GE(layer_, 0) << "The net has no InnerProduct layer";
+
+  // transpose the weights, so the weights of an input are contiguous
+  const std::vector<boost::shared_ptr<caffe::Blob<float> > >& blobs = layers[layer_]->blobs();
+  outputs_ = blobs[0]->shape(0);
+  inputs_ = blobs[0]->count() / outputs_;
+  const float* pWeights = blobs[0]->cpu_data();
+  weights_.resize(inputs_ * outputs_);
+  for (int o = 0; o < outputs_; o++)
+  {
+    for (int i = 0; i < inputs_; i++)
+    {
+      weights_[i * outputs_ + o] = pWeights[o * inputs_ + i];
+    }
+  }
+
+  if (blobs.size() > 1)
+  {
+    bias_.assign(blobs[1]->cpu_data(), blobs[1]->cpu_data() + outputs_);
+  }
+  else
+  {
+    bias_.assign(outputs_, 0.0f);
+  }
+}
+
+void
+BinaryInnerProduct::Forward(const boost::uint64_t* bits, float* output) const
+{
+  std::copy(bias_.begin(), bias_.end(), output);
+
+  // add the weights of every set bit
+  const int iWords = (inputs_ + 63) / 64;
+  for (int w = 0; w < iWords; w++)
+  {
+    for (boost::uint64_t word = bits[w]; word != 0; word &= word - 1)
+    {
+      const float* pWeights = &weights_[(w * 64 + LowestBit(word)) * outputs_];
+      for (int o = 0; o < outputs_; o++)
+      {
+        output[o] += pWeights[o];
+      }
+    }
+  }
+}
@@ -0,0 +1,43 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#ifndef SHAPE_BINARY_INNER_PRODUCT_HPP_
+#define SHAPE_BINARY_INNER_PRODUCT_HPP_
+
+#include <boost/cstdint.hpp>
+#include <caffe/caffe.hpp>
+#include <vector>
+
+// Computes the first InnerProduct layer of a net for binary inputs, packed as bits (see
+// PatchExtractor::Pack). Every input is 0 or 1, so an output is the bias plus the sum of
+// the weights of the inputs that are set. The weights are stored per input, which makes
+// that a sum of a contiguous row for every set bit instead of a multiplication for every
+// input. Caffe can run the rest of the net from the output of the layer.
+// It only reads its weights, so it can be used by all threads at the same time.
+class BinaryInnerProduct
+{
+public:
+  // takes the trained weights of the first layer of net, which must be an InnerProduct layer
+  explicit BinaryInnerProduct(const caffe::Net<float>& net);
+
+  // index of the layer in the net
+  int layer() const { return layer_; }
+
+  int inputs() const { return inputs_; }
+  int outputs() const { return outputs_; }
+
+  // Writes the outputs() values of the layer for the inputs() bits of bits to output
+  void Forward(const boost::uint64_t* bits, float* output) const;
+
+private:
+  int layer_;
+  int inputs_;
+  int outputs_;
+  std::vector<float> weights_; // inputs x outputs
+  std::vector<float> bias_;
+};
+
+#endif // SHAPE_BINARY_INNER_PRODUCT_HPP_
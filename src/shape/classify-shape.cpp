@@ -4,20 +4,927 @@
 //
 // For full license view project root directory
 
-// This program classifies a random generated image using a network and a trained model
+// This program classifies random generated images using a network and a trained model
 // Usage:
-//  classify-shape NET MODEL
+//  classify-shape [FLAGS] NET MODEL
+//  classify-shape --server [FLAGS] NET MODEL
+//  classify-shape --packed [FLAGS] PACKED_NET
+//  classify-shape --image=FILE --result=FILE [FLAGS] NET MODEL
+//  classify-shape --sequence=DIR [FLAGS] NET MODEL
 //
 
 #include <gflags/gflags.h>
 #include <caffe/util/db.hpp>
 #include <caffe/caffe.hpp>
+#include <caffe/util/benchmark.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <string>
 #include <vector>
 #include <algorithm>
 
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <sys/resource.h>
+
+#include "argmax.hpp"
+#include "binary-inner-product.hpp"
+#include "image-bands.hpp"
+#include "line-server.hpp"
+#include "packed-net.hpp"
+#include "patch-extractor.hpp"
+#include "profiler.hpp"
+#include "quantized-mlp.hpp"
+#include "random-shape-image.hpp"
+
+// define gflags FLAGS and default values
+DEFINE_int32(rows_per_batch, 1, "Number of image rows {nr} classified in a single forward pass, use 0 to classify the whole image at once");
+DEFINE_int32(threads, 1, "Number of threads {nr} that classify image rows in parallel, each with its own net");
+DEFINE_int32(num_images, 1, "Number of random generated images {nr} to classify");
+DEFINE_bool(headless, false, "Don't show the images and don't wait for a key press, so it can run without a display");
+DEFINE_string(output_dir, "", "Directory where the input and result images are written to, nothing is written when empty");
+DEFINE_bool(skip_empty, true, "Don't run the net for pixels of which the kernel holds only background, but use the (cached) class of an empty kernel");
+DEFINE_bool(benchmark, false, "Measure the time of each stage over num_images images and report it as JSON, implies headless");
+DEFINE_int32(warmup_images, 5, "Number of images {nr} classified before the benchmark measurements start");
+DEFINE_string(benchmark_file, "", "File the benchmark JSON is written to, it is written to stdout when empty");
+DEFINE_bool(server, false, "Keep the net loaded and classify the image files of the requests, read from stdin or the socket");
+DEFINE_string(socket, "", "Unix domain socket the server listens on, stdin/stdout is used when empty");
+DEFINE_int32(max_batch, 16, "Maximum number of requests {nr} the server handles at once");
+DEFINE_string(precision, "fp32", "Precision of the net weights: fp32 (Caffe), fp16 or int8; fp16 and int8 need the patch net");
+DEFINE_bool(binary_ip1, false, "Compute the first layer of the patch net from the binary patches packed as bits, Caffe runs the other layers");
+DEFINE_bool(packed, false, "The net and its trained model are a single file written by pack-net, instead of NET MODEL");
+DEFINE_string(profile, "", "File a Chrome trace (JSON) of the time of every layer and stage is written to, a summary is printed as well");
+DEFINE_bool(compare_fp32, false, "Also classify with the fp32 net and report the difference in accuracy with the reduced precision");
+DEFINE_string(image, "", "Image file of any size to classify in bands instead of random generated images");
+DEFINE_string(result, "", "PPM file the classification result of image is written to while the bands are classified");
+DEFINE_int32(band_rows, 256, "Number of image rows {nr} of the bands image is classified in, this limits the memory use");
+DEFINE_string(sequence, "", "Directory with the frames of a sequence (in name order) to classify, only the pixels around changes since the previous frame are classified again");
+DEFINE_bool(evaluate, false, "Classify num_images images and report the confusion matrix, the precision, recall and F1 of every class and the pixels per second, implies headless");
+
+// three outputs; either 0 (background), 1 (circle) or 2 (square)
+const int iNumOfOutputs = 3;
+
+// pixel counts and stage times for statistics, every thread keeps its own
+struct tCounts
+{
+  tCounts() : iProcessedPixels(0), iForwardedPixels(0), iCachedPixels(0), iForwardCalls(0),
+              iReferenceCorrectPixels(0), iReferenceEqualPixels(0),
+              dBinarizeTime(0), dExtractTime(0), dForwardTime(0), dPostprocessTime(0), dReferenceForwardTime(0)
+  {
+    std::fill(&iConfusion[0][0], &iConfusion[0][0] + iNumOfOutputs * iNumOfOutputs, 0);
+  }
+
+  void add(const tCounts& other)
+  {
+    iProcessedPixels += other.iProcessedPixels;
+    iForwardedPixels += other.iForwardedPixels;
+    iCachedPixels += other.iCachedPixels;
+    iForwardCalls += other.iForwardCalls;
+    iReferenceCorrectPixels += other.iReferenceCorrectPixels;
+    iReferenceEqualPixels += other.iReferenceEqualPixels;
+    dBinarizeTime += other.dBinarizeTime;
+    dExtractTime += other.dExtractTime;
+    dForwardTime += other.dForwardTime;
+    dPostprocessTime += other.dPostprocessTime;
+    dReferenceForwardTime += other.dReferenceForwardTime;
+    for (int i = 0; i < iNumOfOutputs; ++i)
+    {
+      for (int j = 0; j < iNumOfOutputs; ++j)
+      {
+        iConfusion[i][j] += other.iConfusion[i][j];
+      }
+    }
+  }
+
+  // pixels of class i
+  long pixels(const int i) const
+  {
+    long iPixels = 0;
+    for (int j = 0; j < iNumOfOutputs; ++j)
+      iPixels += iConfusion[i][j];
+    return iPixels;
+  }
+
+  // pixels classified as class j
+  long classified(const int j) const
+  {
+    long iPixels = 0;
+    for (int i = 0; i < iNumOfOutputs; ++i)
+      iPixels += iConfusion[i][j];
+    return iPixels;
+  }
+
+  // correctly classified pixels of all classes
+  long correct() const
+  {
+    long iPixels = 0;
+    for (int i = 0; i < iNumOfOutputs; ++i)
+      iPixels += iConfusion[i][i];
+    return iPixels;
+  }
+
+  long iProcessedPixels;
+  long iForwardedPixels; // pixels that went through the net
+  long iCachedPixels;    // pixels that kept their class of the previous frame
+  long iConfusion[iNumOfOutputs][iNumOfOutputs]; // pixels of class i (the input color) classified as class j
+  long iForwardCalls;
+
+  // comparison with the fp32 net when classifying with reduced precision
+  long iReferenceCorrectPixels; // pixels the fp32 net classifies correctly
+  long iReferenceEqualPixels;   // pixels both classify the same
+
+  // time (ms) spent in each stage, summed over all threads
+  double dBinarizeTime;    // binarizing the image
+  double dExtractTime;     // creating the net input from the image
+  double dForwardTime;     // forward pass of the net
+  double dPostprocessTime; // finding the classes, drawing the output image and counting
+  double dReferenceForwardTime; // forward pass of the fp32 net to compare with
+};
+
+// settings that are the same for all threads
+struct tOptions
+{
+  int iRowsPerBatch; // number of image rows classified in a single forward pass, 0 for all rows
+  bool bSkipEmpty;   // use iEmptyClass for pixels with an empty patch instead of the net
+  int iEmptyClass;   // class of an empty patch
+  bool bCompare;     // also classify with the fp32 net when classifying with reduced precision
+  int iReferenceEmptyClass; // class of an empty patch of the fp32 net
+  const BinaryInnerProduct* binary_ip; // computes the first layer of the net instead of Caffe when given
+  const cv::Mat* dirty; // only pixels that are set (CV_8U) are classified, the others keep their class in labels
+  cv::Mat* labels;      // class of every pixel (CV_8U) of the previous frame, updated when given
+  Profiler* profiler;   // times the layers and stages when given
+};
+
+// index in the net input of a pixel that isn't classified by the net
+const int kEmptyPatch = -1;  // gets the empty class
+const int kCachedPatch = -2; // keeps its class in the label map
+
+// Returns the class of a patch that holds only background, which is the same for every
+// empty patch so it only has to be found once per model.
+static int
+ClassifyEmptyPatch(caffe::Net<float>* net, const int kernel)
+{
+  // a single patch, or a single kernel sized image for a fully convolutional net
+  caffe::Blob<float>* input_blob = net->input_blobs()[0];
+  std::vector<int> vShape;
+  vShape.push_back(1);
+  if (input_blob->num_axes() == 4)
+  {
+    vShape.push_back(1);
+    vShape.push_back(kernel);
+    vShape.push_back(kernel);
+  }
+  else
+  {
+    vShape.push_back(kernel * kernel);
+  }
+  input_blob->Reshape(vShape);
+  net->Reshape();
+  std::fill(input_blob->mutable_cpu_data(), input_blob->mutable_cpu_data() + input_blob->count(), 0.0f);
+
+  // forward pass
+  float loss = 0.0;
+  const std::vector<caffe::Blob<float>*>& result = net->Forward(&loss);
+
+  // find maximum
+  const float* pResult = result[0]->cpu_data();
+  return std::max_element(pResult, pResult + iNumOfOutputs) - pResult;
+}
+
+// Returns the class of a patch that holds only background with reduced precision
+static int
+ClassifyEmptyPatch(QuantizedMlp* mlp)
+{
+  const std::vector<float> input(mlp->input_size(), 0.0f);
+  std::vector<float> output(mlp->output_size());
+  mlp->Forward(&input[0], 1, &output[0]);
+  return std::max_element(output.begin(), output.end()) - output.begin();
+}
+
+// Finds the class of every pixel of a batch from the output of the net, for iNetSize
+// patches. When net_index is given it holds the index of the patch of every pixel, pixels
+// without a patch (a negative index) get the empty class.
+static void
+LabelBatch(const float* pResult,
+           const int iNetSize,
+           const int iClassStep,
+           const int iPatchStep,
+           const std::vector<int>* net_index,
+           const int iEmptyClass,
+           std::vector<unsigned char>* net_labels,
+           std::vector<unsigned char>* labels)
+{
+  if (net_index)
+  {
+    net_labels->resize(iNetSize);
+    if (iNetSize > 0)
+    {
+      ArgmaxChannels(pResult, iNumOfOutputs, iNetSize, iClassStep, iPatchStep, &(*net_labels)[0]);
+    }
+    labels->resize(net_index->size());
+    for (size_t batch = 0; batch < net_index->size(); batch++)
+    {
+      (*labels)[batch] = ((*net_index)[batch] < 0) ? static_cast<unsigned char>(iEmptyClass)
+                                                   : (*net_labels)[(*net_index)[batch]];
+    }
+  }
+  else
+  {
+    labels->resize(iNetSize);
+    ArgmaxChannels(pResult, iNumOfOutputs, iNetSize, iClassStep, iPatchStep, &(*labels)[0]);
+  }
+}
+
+// Classifies the image rows [y_begin, y_end) with net, draws the classification result
+// in out_image_bgr and counts the (correctly) classified pixels in counts.
+// Pixels of which the patch is empty get the empty class when the options say so, and
+// pixels that are not dirty keep their class in the label map of the options.
+// With mlp the patches are classified with reduced precision instead of by net.
+// Different threads can classify different rows at the same time as long as each
+// thread uses its own net, mlp and counts; they only write their own rows of out_image_bgr.
+static void
+ClassifyRows(caffe::Net<float>* net,
+             QuantizedMlp* mlp,
+             const tOptions* options,
+             const PatchExtractor* extractor,
+             const cv::Mat* in_image_bgr,
+             const int y_begin,
+             const int y_end,
+             cv::Mat* out_image_bgr,
+             tCounts* counts)
+{
+  const int h_kernel = extractor->kernel() / 2;
+  const int iPatchesPerLine = in_image_bgr->cols - 2 * h_kernel;
+
+  // colors of the classes
+  const cv::Vec3b class_colors[iNumOfOutputs] = {
+    cv::Vec3b(0, 0, 0),   // class 0: background
+    cv::Vec3b(0, 255, 0), // class 1: circle
+    cv::Vec3b(0, 0, 255)  // class 2: square
+  };
+
+  // a fully convolutional net classifies whole image lines, so it can't skip pixels
+  caffe::Blob<float>* input_blob = net->input_blobs()[0];
+  const bool bFullyConvolutional = (input_blob->num_axes() == 4);
+  const bool bSkip = options->bSkipEmpty && !bFullyConvolutional;
+  const cv::Mat* dirty = options->dirty;
+  const bool bIndex = bSkip || dirty;
+  const int iRowsPerBatch = (options->iRowsPerBatch == 0) ? std::max(y_end - y_begin, 1) : options->iRowsPerBatch;
+
+  // index of the patch of every pixel of a batch in the net input, negative for skipped pixels
+  std::vector<int> vNetIndex;
+
+  // class of every pixel of a batch, and of every patch that went through the net
+  std::vector<unsigned char> vLabels;
+  std::vector<unsigned char> vNetLabels;
+
+  // packed patch for the binary first layer
+  std::vector<boost::uint64_t> vBits(extractor->packed_size());
+
+  // output of the reduced precision net, and the classes of the fp32 net to compare with
+  std::vector<float> vOutput;
+  const BinaryInnerProduct* binary_ip = options->binary_ip;
+  if (binary_ip)
+  {
+    // a net for another kernel size would read past the packed patch
+    CHECK_EQ(binary_ip->inputs(), extractor->patch_size()) << "The first layer of the net doesn't take patches of " << extractor->kernel() << "x" << extractor->kernel() << " pixels";
+  }
+  const bool bCompare = (mlp || binary_ip) && options->bCompare;
+  std::vector<unsigned char> vReferenceLabels;
+
+  caffe::CPUTimer timer;
+  Profiler* profiler = options->profiler;
+  Profiler::Stage stage(profiler);
+  for (int y_batch = y_begin; y_batch < y_end; y_batch += iRowsPerBatch)
+  {
+    const int iBatchLines = std::min(iRowsPerBatch, y_end - y_batch);
+    const int iBatchSize = iBatchLines * iPatchesPerLine;
+
+    // find the pixels that need the net
+    timer.Start();
+    stage.Start("index");
+    int iNetSize = iBatchSize;
+    if (bIndex)
+    {
+      iNetSize = 0;
+      vNetIndex.resize(iBatchSize);
+      for (int y = y_batch, batch = 0; y < y_batch + iBatchLines; y++)
+      {
+        const unsigned char* pDirty = dirty ? dirty->ptr<unsigned char>(y) : NULL;
+        for (int x = h_kernel; x < in_image_bgr->cols - h_kernel; x++, batch++)
+        {
+          if (pDirty && !pDirty[x])
+          {
+            vNetIndex[batch] = kCachedPatch;
+            counts->iCachedPixels++;
+          }
+          else
+          {
+            vNetIndex[batch] = (bSkip && extractor->IsEmpty(x, y)) ? kEmptyPatch : iNetSize++;
+          }
+        }
+      }
+    }
+    counts->iForwardedPixels += iNetSize;
+
+    // the net input must have the same size as the batch, only reshape when it differs
+    // (the last batch can hold less lines than the others, and the number of skipped pixels varies)
+    std::vector<int> vShape;
+    if (bFullyConvolutional)
+    {
+      // the net slides the kernel over the image itself, so the input is the part of the
+      // image that holds the batch lines and the half kernel above and below them
+      vShape.push_back(1);
+      vShape.push_back(1);
+      vShape.push_back(iBatchLines + 2 * h_kernel);
+      vShape.push_back(in_image_bgr->cols);
+    }
+    else
+    {
+      // one patch per (not skipped) pixel
+      vShape.push_back(iNetSize);
+      vShape.push_back(extractor->patch_size());
+    }
+    if (iNetSize > 0 && input_blob->shape() != vShape)
+    {
+      input_blob->Reshape(vShape);
+      net->Reshape();
+    }
+
+    // create input data for a number of lines which is much faster (instead of a classification per pixel),
+    // the data is written directly in the input blob of the net
+    stage.Start("extract");
+    if (binary_ip && !bCompare)
+    {
+      // the first layer takes the packed patches directly from the image
+    }
+    else if (bFullyConvolutional)
+    {
+      extractor->CopyLines(y_batch - h_kernel, y_batch + iBatchLines + h_kernel, input_blob->mutable_cpu_data());
+    }
+    else if (bIndex)
+    {
+      float* pData = input_blob->mutable_cpu_data();
+      for (int y = y_batch, batch = 0; y < y_batch + iBatchLines; y++)
+      {
+        for (int x = h_kernel; x < in_image_bgr->cols - h_kernel; x++, batch++)
+        {
+          if (vNetIndex[batch] >= 0)
+          {
+            extractor->Extract(x, y, pData);
+            pData += extractor->patch_size();
+          }
+        }
+      }
+    }
+    else
+    {
+      extractor->ExtractLines(y_batch, y_batch + iBatchLines, input_blob->mutable_cpu_data());
+    }
+
+    counts->dExtractTime += timer.MilliSeconds();
+    stage.Stop();
+
+    // forward pass, unless all pixels are skipped
+    const float* pResult = NULL;
+    if (iNetSize > 0)
+    {
+      timer.Start();
+      if (mlp)
+      {
+        stage.Start("quantized forward");
+        vOutput.resize(iNetSize * iNumOfOutputs);
+        mlp->Forward(input_blob->cpu_data(), iNetSize, &vOutput[0]);
+        pResult = &vOutput[0];
+      }
+      else if (binary_ip)
+      {
+        // compute the output of the first layer for every patch and let Caffe do the rest
+        stage.Start("binary ip1");
+        float* pOutput = net->top_vecs()[binary_ip->layer()][0]->mutable_cpu_data();
+        for (int y = y_batch, batch = 0; y < y_batch + iBatchLines; y++)
+        {
+          for (int x = h_kernel; x < in_image_bgr->cols - h_kernel; x++, batch++)
+          {
+            if (!bIndex || vNetIndex[batch] >= 0)
+            {
+              extractor->Pack(x, y, &vBits[0]);
+              binary_ip->Forward(&vBits[0], pOutput);
+              pOutput += binary_ip->outputs();
+            }
+          }
+        }
+        stage.Stop();
+        if (profiler)
+        {
+          profiler->ForwardFrom(net, binary_ip->layer() + 1);
+        }
+        else
+        {
+          net->ForwardFrom(binary_ip->layer() + 1);
+        }
+        pResult = net->output_blobs()[0]->cpu_data();
+
+        // the fp32 net overwrites the output
+        if (bCompare)
+        {
+          vOutput.assign(pResult, pResult + iNetSize * iNumOfOutputs);
+          pResult = &vOutput[0];
+        }
+      }
+      else
+      {
+        if (profiler)
+        {
+          profiler->ForwardFrom(net, 0);
+        }
+        else
+        {
+          float loss = 0.0;
+          net->Forward(&loss);
+        }
+        pResult = net->output_blobs()[0]->cpu_data();
+      }
+      stage.Stop();
+      counts->iForwardCalls++;
+      counts->dForwardTime += timer.MilliSeconds();
+    }
+
+    // the output of a fully convolutional net is a map per class (1 x classes x lines x patches per line),
+    // otherwise it holds the class values of one patch after another (patches x classes)
+    const int iClassStep = bFullyConvolutional ? iBatchSize : 1;
+    const int iPatchStep = bFullyConvolutional ? 1 : iNumOfOutputs;
+
+    // the classes of the fp32 net, its time doesn't count
+    if (bCompare)
+    {
+      const float* pReference = NULL;
+      if (iNetSize > 0)
+      {
+        timer.Start();
+        float loss = 0.0;
+        pReference = net->Forward(&loss)[0]->cpu_data();
+        counts->dReferenceForwardTime += timer.MilliSeconds();
+      }
+      LabelBatch(pReference, iNetSize, iClassStep, iPatchStep, bIndex ? &vNetIndex : NULL,
+                 options->iReferenceEmptyClass, &vNetLabels, &vReferenceLabels);
+    }
+
+    timer.Start();
+    stage.Start("argmax");
+
+    // find the class of every pixel of the batch, skipped pixels get the empty class
+    LabelBatch(pResult, iNetSize, iClassStep, iPatchStep, bIndex ? &vNetIndex : NULL,
+               options->iEmptyClass, &vNetLabels, &vLabels);
+
+    // pixels that are not dirty keep their class, the others update the label map
+    if (options->labels)
+    {
+      for (int y = y_batch, batch = 0; y < y_batch + iBatchLines; y++)
+      {
+        unsigned char* pLabel = options->labels->ptr<unsigned char>(y);
+        for (int x = h_kernel; x < in_image_bgr->cols - h_kernel; x++, batch++)
+        {
+          if (bIndex && vNetIndex[batch] == kCachedPatch)
+          {
+            vLabels[batch] = pLabel[x];
+          }
+          else
+          {
+            pLabel[x] = vLabels[batch];
+          }
+        }
+      }
+    }
+
+    stage.Start("draw");
+
+    // mark classification result in output image and count the pixels per class and
+    // classification result, the color of an input pixel is its class
+    for (int y = y_batch; y < y_batch + iBatchLines; y++)
+    {
+      const unsigned char* pLabels = &vLabels[(y - y_batch) * iPatchesPerLine];
+      const cv::Vec3b* pIn = in_image_bgr->ptr<cv::Vec3b>(y) + h_kernel;
+      cv::Vec3b* pOut = out_image_bgr->ptr<cv::Vec3b>(y) + h_kernel;
+      for (int i = 0; i < iPatchesPerLine; i++)
+      {
+        pOut[i] = class_colors[pLabels[i]];
+        for (int c = 0; c < iNumOfOutputs; ++c)
+        {
+          if (pIn[i] == class_colors[c])
+          {
+            counts->iConfusion[c][pLabels[i]]++;
+            if (bCompare && vReferenceLabels[(y - y_batch) * iPatchesPerLine + i] == c)
+            {
+              counts->iReferenceCorrectPixels++;
+            }
+            break;
+          }
+        }
+      }
+    }
+    if (bCompare)
+    {
+      for (int batch = 0; batch < iBatchSize; batch++)
+      {
+        counts->iReferenceEqualPixels += (vLabels[batch] == vReferenceLabels[batch]);
+      }
+    }
+    counts->iProcessedPixels += iBatchSize;
+    counts->dPostprocessTime += timer.MilliSeconds();
+    stage.Stop();
+  }
+}
+
+// Classifies in_image (the binarized in_image_bgr) with the nets, in parallel when there
+// is more than one net, and adds the statistics to counts.
+// The reduced precision mlps (one per net) are used instead of the nets when there are any.
+static void
+ClassifyImage(const std::vector<boost::shared_ptr<caffe::Net<float> > >& nets,
+              const std::vector<boost::shared_ptr<QuantizedMlp> >& mlps,
+              const tOptions& options,
+              const int kernel,
+              const cv::Mat& in_image_bgr,
+              const cv::Mat& in_image,
+              cv::Mat* out_image_bgr,
+              tCounts* counts)
+{
+  const int h_kernel = kernel / 2;
+  caffe::CPUTimer timer;
+  timer.Start();
+  Profiler::Stage stage(options.profiler);
+  stage.Start("binarize");
+  const PatchExtractor extractor(in_image, kernel);
+  stage.Stop();
+  counts->dBinarizeTime += timer.MilliSeconds();
+
+  // create output image
+  *out_image_bgr = cv::Mat::zeros(in_image.size(), CV_8UC3);
+
+  // divide the image rows over the threads
+  const int iRows = in_image.rows - 2 * h_kernel;
+  const int iRowsPerThread = (iRows + static_cast<int>(nets.size()) - 1) / static_cast<int>(nets.size());
+  std::vector<tCounts> thread_counts(nets.size());
+  boost::thread_group threads;
+  for (size_t i = 0; i < nets.size(); i++)
+  {
+    const int y_begin = std::min(h_kernel + static_cast<int>(i) * iRowsPerThread, in_image.rows - h_kernel);
+    const int y_end = std::min(y_begin + iRowsPerThread, in_image.rows - h_kernel);
+    threads.create_thread(boost::bind(&ClassifyRows,
+                                      nets[i].get(),
+                                      mlps.empty() ? NULL : mlps[i].get(),
+                                      &options,
+                                      &extractor,
+                                      &in_image_bgr,
+                                      y_begin,
+                                      y_end,
+                                      out_image_bgr,
+                                      &thread_counts[i]));
+  }
+  threads.join_all();
+
+  // merge the counts of all threads
+  for (size_t i = 0; i < thread_counts.size(); i++)
+  {
+    counts->add(thread_counts[i]);
+  }
+}
+
+// Classifies the image file in_path band after band of band_rows rows, and writes the
+// result to out_path while doing so. The bands overlap with the rows of half a kernel
+// (the halo) above and below, so the result is the same as for the whole image, but
+// only a band of the image, its patches and its result are in memory at a time.
+static void
+ClassifyBands(const std::vector<boost::shared_ptr<caffe::Net<float> > >& nets,
+              const std::vector<boost::shared_ptr<QuantizedMlp> >& mlps,
+              const tOptions& options,
+              const int kernel,
+              const std::string& in_path,
+              const std::string& out_path,
+              const int band_rows,
+              tCounts* counts,
+              int* bands)
+{
+  const int h_kernel = kernel / 2;
+  BandReader reader(in_path);
+  CHECK(reader.rows() > 2 * h_kernel && reader.cols() > 2 * h_kernel) << in_path << " is smaller than the kernel";
+  BandWriter writer(out_path, reader.rows(), reader.cols());
+
+  // the rows of half a kernel at the top and bottom of the image are not classified
+  const cv::Mat border = cv::Mat::zeros(h_kernel, reader.cols(), CV_8UC3);
+  writer.Write(border);
+
+  // the band and its halo, the halo at the bottom is the halo at the top of the next band
+  cv::Mat in_image_bgr;
+  while (reader.position() < reader.rows())
+  {
+    cv::Mat lines;
+    reader.Read(band_rows + 2 * h_kernel - in_image_bgr.rows, &lines);
+    if (in_image_bgr.empty())
+    {
+      in_image_bgr = lines;
+    }
+    else
+    {
+      cv::Mat band_bgr;
+      cv::vconcat(in_image_bgr, lines, band_bgr);
+      in_image_bgr = band_bgr;
+    }
+
+    // binarize for classification
+    caffe::CPUTimer timer;
+    timer.Start();
+    cv::Mat in_image_gray;
+    cv::cvtColor(in_image_bgr, in_image_gray, CV_RGB2GRAY);
+    const cv::Mat in_image = in_image_gray > 0;
+    counts->dBinarizeTime += timer.MilliSeconds();
+
+    cv::Mat out_image_bgr;
+    ClassifyImage(nets, mlps, options, kernel, in_image_bgr, in_image, &out_image_bgr, counts);
+    writer.Write(out_image_bgr.rowRange(h_kernel, out_image_bgr.rows - h_kernel));
+    (*bands)++;
+
+    in_image_bgr = in_image_bgr.rowRange(in_image_bgr.rows - 2 * h_kernel, in_image_bgr.rows).clone();
+  }
+
+  writer.Write(border);
+}
+
+// Classifies the frames of a sequence one after another. The pixels that changed since
+// the previous frame are dilated by the kernel, which gives the pixels of which the patch
+// changed; only those are classified again and the others keep their class of the
+// previous frame. The first frame, and a frame that differs in size from the previous
+// one, is classified completely. Results are written to out_dir when it isn't empty.
+// Returns the time (s) spent on classifying the frames.
+static double
+ClassifySequence(const std::vector<boost::shared_ptr<caffe::Net<float> > >& nets,
+                 const std::vector<boost::shared_ptr<QuantizedMlp> >& mlps,
+                 const tOptions& options,
+                 const int kernel,
+                 const std::vector<std::string>& frames,
+                 const std::string& out_dir,
+                 tCounts* counts)
+{
+  const cv::Mat receptive_field = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(kernel, kernel));
+  tOptions frame_options = options;
+  cv::Mat previous_image, labels, dirty;
+  double dSeconds = 0;
+  caffe::CPUTimer timer;
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    const cv::Mat in_image_bgr = cv::imread(frames[i], CV_LOAD_IMAGE_COLOR);
+    CHECK(!in_image_bgr.empty()) << "Cannot read " << frames[i];
+    CHECK(in_image_bgr.rows > kernel && in_image_bgr.cols > kernel) << frames[i] << " is smaller than the kernel";
+
+    // binarize for classification
+    timer.Start();
+    cv::Mat in_image_gray;
+    cv::cvtColor(in_image_bgr, in_image_gray, CV_RGB2GRAY);
+    const cv::Mat in_image = in_image_gray > 0;
+
+    // find the pixels of which the patch changed
+    if (previous_image.size() == in_image.size())
+    {
+      cv::dilate(in_image != previous_image, dirty, receptive_field);
+      frame_options.dirty = &dirty;
+    }
+    else
+    {
+      labels = cv::Mat::zeros(in_image.size(), CV_8U);
+      frame_options.dirty = NULL;
+    }
+    frame_options.labels = &labels;
+    previous_image = in_image;
+
+    cv::Mat out_image_bgr;
+    tCounts frame_counts;
+    ClassifyImage(nets, mlps, frame_options, kernel, in_image_bgr, in_image, &out_image_bgr, &frame_counts);
+    dSeconds += timer.Seconds();
+    counts->add(frame_counts);
+
+    std::cout << "frame " << i << ": classified " << 100 - static_cast<double>(frame_counts.iCachedPixels) / frame_counts.iProcessedPixels * 100
+              << "% of the pixels again" << std::endl;
+
+    if (!out_dir.empty())
+    {
+      std::stringstream ss;
+      ss << out_dir << "/" << std::setw(6) << std::setfill('0') << i << "-result.png";
+      cv::imwrite(ss.str(), out_image_bgr);
+    }
+  }
+  return dSeconds;
+}
+
+// Server handler; a request is the path of an image with shapes in the colors of the
+// generated images, optionally followed by the path the result image is written to.
+// Its response is the percentage of correctly classified pixels followed by that
+// percentage for every class.
+static void
+ServeRequests(const std::vector<boost::shared_ptr<caffe::Net<float> > >* nets,
+              const std::vector<boost::shared_ptr<QuantizedMlp> >* mlps,
+              const tOptions* options,
+              const int kernel,
+              const std::vector<std::string>& requests,
+              std::vector<std::string>* responses)
+{
+  for (size_t i = 0; i < requests.size(); i++)
+  {
+    std::istringstream request(requests[i]);
+    std::string sIn, sOut;
+    request >> sIn >> sOut;
+    const cv::Mat in_image_bgr = cv::imread(sIn, CV_LOAD_IMAGE_COLOR);
+    if (in_image_bgr.empty() || in_image_bgr.rows <= kernel || in_image_bgr.cols <= kernel)
+    {
+      responses->push_back("error: cannot classify " + sIn);
+      continue;
+    }
+
+    // binarize for classification
+    cv::Mat in_image_gray;
+    cv::cvtColor(in_image_bgr, in_image_gray, CV_RGB2GRAY);
+    const cv::Mat in_image = in_image_gray > 0;
+
+    cv::Mat out_image_bgr;
+    tCounts counts;
+    ClassifyImage(*nets, *mlps, *options, kernel, in_image_bgr, in_image, &out_image_bgr, &counts);
+    if (!sOut.empty() && !cv::imwrite(sOut, out_image_bgr))
+    {
+      responses->push_back("error: cannot write " + sOut);
+      continue;
+    }
+
+    std::ostringstream response;
+    response << static_cast<double>(counts.correct()) / counts.iProcessedPixels * 100;
+    for (int j = 0; j < iNumOfOutputs; ++j)
+    {
+      response << " " << (counts.pixels(j) > 0 ? static_cast<double>(counts.iConfusion[j][j]) / counts.pixels(j) * 100 : 100);
+    }
+    responses->push_back(response.str());
+  }
+}
+
+// prints the classification statistics to out
+static void
+PrintCounts(const tCounts& counts, std::ostream& out)
+{
+  for (int i = 0; i < iNumOfOutputs; ++i)
+  {
+    out << "classified " << static_cast<double>(counts.iConfusion[i][i]) / counts.pixels(i) * 100 << "% correctly in class " << i << std::endl;
+  }
+  out << "classified " <<
+    static_cast<double>(counts.correct()) / counts.iProcessedPixels * 100
+    << "% in total correctly" << std::endl;
+  out << "classified " << static_cast<double>(counts.iForwardedPixels) / counts.iProcessedPixels * 100
+    << "% of the pixels with the net" << std::endl;
+}
+
+// prints the classification statistics of image files, of which only the pixels in the
+// color of a class are counted
+static void
+PrintFileCounts(const tCounts& counts)
+{
+  long iColoredPixels = 0;
+  for (int i = 0; i < iNumOfOutputs; ++i)
+  {
+    iColoredPixels += counts.pixels(i);
+  }
+  if (iColoredPixels > 0)
+  {
+    std::cout << "classified " << static_cast<double>(counts.correct()) / iColoredPixels * 100
+              << "% of the pixels in the color of a class correctly" << std::endl;
+  }
+  std::cout << "classified " << static_cast<double>(counts.iForwardedPixels) / counts.iProcessedPixels * 100
+            << "% of the pixels with the net" << std::endl;
+}
+
+// prints the confusion matrix, the precision, recall and F1 of every class and the
+// number of pixels classified per second to out
+static void
+PrintEvaluation(const tCounts& counts, const int images, const double dSeconds, std::ostream& out)
+{
+  out << "confusion matrix (rows: class, columns: classified as)" << std::endl;
+  out << std::setw(8) << "";
+  for (int j = 0; j < iNumOfOutputs; ++j)
+  {
+    out << std::setw(12) << j;
+  }
+  out << std::endl;
+  for (int i = 0; i < iNumOfOutputs; ++i)
+  {
+    out << std::setw(8) << i;
+    for (int j = 0; j < iNumOfOutputs; ++j)
+    {
+      out << std::setw(12) << counts.iConfusion[i][j];
+    }
+    out << std::endl;
+  }
+
+  out << std::endl << std::setw(8) << "class" << std::setw(12) << "precision"
+            << std::setw(12) << "recall" << std::setw(12) << "F1" << std::setw(12) << "pixels" << std::endl;
+  double dMeanF1 = 0;
+  for (int i = 0; i < iNumOfOutputs; ++i)
+  {
+    const double dPrecision = counts.classified(i) > 0 ? static_cast<double>(counts.iConfusion[i][i]) / counts.classified(i) : 0;
+    const double dRecall = counts.pixels(i) > 0 ? static_cast<double>(counts.iConfusion[i][i]) / counts.pixels(i) : 0;
+    const double dF1 = (dPrecision + dRecall) > 0 ? 2 * dPrecision * dRecall / (dPrecision + dRecall) : 0;
+    dMeanF1 += dF1 / iNumOfOutputs;
+    out << std::setw(8) << i << std::setw(12) << dPrecision << std::setw(12) << dRecall
+              << std::setw(12) << dF1 << std::setw(12) << counts.pixels(i) << std::endl;
+  }
+
+  out << std::endl;
+  out << "accuracy: " << static_cast<double>(counts.correct()) / counts.iProcessedPixels << std::endl;
+  out << "mean F1: " << dMeanF1 << std::endl;
+  out << "images: " << images << " pixels: " << counts.iProcessedPixels << std::endl;
+  out << "pixels per second: " << (dSeconds > 0 ? counts.iProcessedPixels / dSeconds : 0) << std::endl;
+}
+
+// prints the accuracy and the forward time of the classification by name compared to fp32 to out
+static void
+PrintComparison(const std::string& name, const tCounts& counts, std::ostream& out)
+{
+  const double dAccuracy = static_cast<double>(counts.correct()) / counts.iProcessedPixels * 100;
+  const double dReferenceAccuracy = static_cast<double>(counts.iReferenceCorrectPixels) / counts.iProcessedPixels * 100;
+  out << name << " classified " << dAccuracy << "% in total correctly, fp32 "
+            << dReferenceAccuracy << "% (difference " << dAccuracy - dReferenceAccuracy << "%)" << std::endl;
+  out << name << " and fp32 classified " << static_cast<double>(counts.iReferenceEqualPixels) / counts.iProcessedPixels * 100
+            << "% of the pixels the same" << std::endl;
+  out << name << " forward " << counts.dForwardTime << " ms, fp32 " << counts.dReferenceForwardTime << " ms ("
+      << (counts.dForwardTime > 0 ? counts.dReferenceForwardTime / counts.dForwardTime : 0) << " times as fast)" << std::endl;
+}
+
+// summary of the measurements (ms) of a single stage
+struct tStageTimes
+{
+  std::vector<double> vTimes; // one measurement per image
+
+  double percentile(const double p) const
+  {
+    if (vTimes.empty())
+      return 0;
+    std::vector<double> vSorted(vTimes);
+    std::sort(vSorted.begin(), vSorted.end());
+    // nearest rank
+    const size_t rank = static_cast<size_t>(std::ceil(p / 100 * vSorted.size()));
+    return vSorted[std::max(rank, static_cast<size_t>(1)) - 1];
+  }
+
+  double total() const
+  {
+    double dTotal = 0;
+    for (size_t i = 0; i < vTimes.size(); i++)
+      dTotal += vTimes[i];
+    return dTotal;
+  }
+};
+
+// writes the benchmark result as JSON to out
+static void
+WriteBenchmark(std::ostream& out,
+               const std::vector<std::pair<std::string, tStageTimes> >& stages,
+               const tStageTimes& wall,
+               const tCounts& counts,
+               const double dLoadMs)
+{
+  const double dSeconds = wall.total() / 1000;
+  out << "{\n";
+  out << "  \"images\": " << wall.vTimes.size() << ",\n";
+  out << "  \"warmup_images\": " << FLAGS_warmup_images << ",\n";
+  out << "  \"threads\": " << FLAGS_threads << ",\n";
+  out << "  \"rows_per_batch\": " << FLAGS_rows_per_batch << ",\n";
+  out << "  \"skip_empty\": " << (FLAGS_skip_empty ? "true" : "false") << ",\n";
+  out << "  \"precision\": \"" << FLAGS_precision << "\",\n";
+  out << "  \"binary_ip1\": " << (FLAGS_binary_ip1 ? "true" : "false") << ",\n";
+  out << "  \"packed\": " << (FLAGS_packed ? "true" : "false") << ",\n";
+  out << "  \"load_ms\": " << dLoadMs << ",\n";
+  out << "  \"stages_ms\": {\n";
+  for (size_t i = 0; i < stages.size(); i++)
+  {
+    const tStageTimes& stage = stages[i].second;
+    out << "    \"" << stages[i].first << "\": {"
+        << "\"p50\": " << stage.percentile(50) << ", "
+        << "\"p95\": " << stage.percentile(95) << ", "
+        << "\"p99\": " << stage.percentile(99) << ", "
+        << "\"mean\": " << (stage.vTimes.empty() ? 0 : stage.total() / stage.vTimes.size()) << "}"
+        << (i + 1 < stages.size() ? ",\n" : "\n");
+  }
+  out << "  },\n";
+  out << "  \"pixels\": " << counts.iProcessedPixels << ",\n";
+  out << "  \"forwarded_pixels\": " << counts.iForwardedPixels << ",\n";
+  out << "  \"forward_calls\": " << counts.iForwardCalls << ",\n";
+  out << "  \"pixels_per_second\": " << (dSeconds > 0 ? counts.iProcessedPixels / dSeconds : 0) << ",\n";
+  out << "  \"forward_calls_per_second\": " << (dSeconds > 0 ? counts.iForwardCalls / dSeconds : 0) << "\n";
+  out << "}" << std::endl;
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -27,185 +934,311 @@ main(int argc, char* argv[])
   namespace gflags = google;
 #endif
 
-  gflags::SetUsageMessage("Classifies a random generated image using a network and a trained model\n"
+  gflags::SetUsageMessage("Classifies random generated images using a network and a trained model\n"
                           "Usage:\n"
-                          " classify-shape NET MODEL\n");
+                          " classify-shape [FLAGS] NET MODEL\n"
+                          " classify-shape --server [FLAGS] NET MODEL\n"
+                          " classify-shape --packed [FLAGS] PACKED_NET\n");
   gflags::ParseCommandLineFlags(&argc, &argv, true);
 
-  if (argc != 3)
+  QuantizedMlp::tPrecision precision;
+  const bool bReducedPrecision = QuantizedMlp::ParsePrecision(FLAGS_precision, &precision);
+  if (argc != (FLAGS_packed ? 2 : 3) || FLAGS_band_rows < 1 || FLAGS_image.empty() != FLAGS_result.empty() || FLAGS_rows_per_batch < 0 || FLAGS_threads < 1 || FLAGS_num_images < 1 || FLAGS_warmup_images < 0 || FLAGS_max_batch < 1 ||
+      (!bReducedPrecision && FLAGS_precision != "fp32") ||
+      (FLAGS_benchmark && (FLAGS_server || !FLAGS_image.empty() || !FLAGS_sequence.empty())))
   {
     gflags::ShowUsageWithFlagsRestrict(argv[0], "classify-shape");
     return 1;
   }
 
-  // get the net
-  const std::string sNetwork = argv[1];
-  std::cout << "loading " << sNetwork << std::endl;
-  caffe::Net<float> caffe_test_net(sNetwork, caffe::TEST);
+  // a server uses stdout for its responses, a benchmark for its JSON when it has no file
+  const bool bBenchmarkToStdout = FLAGS_benchmark && FLAGS_benchmark_file.empty();
+  std::ostream& log = (FLAGS_server || bBenchmarkToStdout) ? std::cerr : std::cout;
 
-  // get trained model
-  const std::string sModel = argv[2];
-  std::cout << "loading " << sModel << std::endl;
-  caffe_test_net.CopyTrainedLayersFrom(sModel);
+  // get the net and its trained model, one net for every thread; the trained model is
+  // loaded once and the other nets share its weights
+  caffe::CPUTimer load_timer;
+  load_timer.Start();
+  boost::scoped_ptr<PackedNet> packed_net;
+  std::vector<boost::shared_ptr<caffe::Net<float> > > nets;
+  if (FLAGS_packed)
+  {
+    const std::string sPacked = argv[1];
+    log << "loading " << sPacked << std::endl;
+    packed_net.reset(new PackedNet(sPacked));
+    for (int i = 0; i < FLAGS_threads; i++)
+    {
+      nets.push_back(packed_net->CreateNet());
+    }
+  }
+  else
+  {
+    const std::string sNetwork = argv[1];
+    log << "loading " << sNetwork << std::endl;
+    for (int i = 0; i < FLAGS_threads; i++)
+    {
+      nets.push_back(boost::shared_ptr<caffe::Net<float> >(new caffe::Net<float>(sNetwork, caffe::TEST)));
+    }
 
-  // seed random generator
-  std::srand(std::time(NULL));
+    const std::string sModel = argv[2];
+    log << "loading " << sModel << std::endl;
+    nets[0]->CopyTrainedLayersFrom(sModel);
+    for (size_t i = 1; i < nets.size(); i++)
+    {
+      nets[i]->ShareTrainedLayersWith(nets[0].get());
+    }
+  }
+  load_timer.Stop();
+  log << "loaded in " << load_timer.MilliSeconds() << " ms" << std::endl;
 
-  // generate random input image
-  const int rows = 200;
-  const int cols = 200;
-  cv::Mat in_image_bgr = cv::Mat::zeros(rows, cols, CV_8UC3);
+  // reduced precision copies of the nets, they replace the nets except for creating the input
+  std::vector<boost::shared_ptr<QuantizedMlp> > mlps;
+  if (bReducedPrecision)
+  {
+    CHECK_EQ(nets[0]->input_blobs()[0]->num_axes(), 2) << "Only the patch net can run with " << FLAGS_precision << " precision";
+    for (size_t i = 0; i < nets.size(); i++)
+    {
+      mlps.push_back(boost::shared_ptr<QuantizedMlp>(new QuantizedMlp(*nets[i], precision)));
+    }
+  }
+
+  // the class of pixels which have only background around them is always the same
+  const int kernel = 15;
+  const int iEmptyClass = ClassifyEmptyPatch(nets[0].get(), kernel);
+
+  tOptions options;
+  options.iRowsPerBatch = FLAGS_rows_per_batch;
+  options.bSkipEmpty = FLAGS_skip_empty;
+  options.iEmptyClass = bReducedPrecision ? ClassifyEmptyPatch(mlps[0].get()) : iEmptyClass;
+  options.bCompare = FLAGS_compare_fp32;
+  options.iReferenceEmptyClass = iEmptyClass;
 
-  // 3 squares (red)
-  for (int i = 0; i < 3; i++)
+  // the first layer of the patch net for binary patches, shared by all threads
+  boost::scoped_ptr<BinaryInnerProduct> binary_ip;
+  if (FLAGS_binary_ip1)
   {
-    const int x1 = std::min(std::max(((float)std::rand() / RAND_MAX) * in_image_bgr.cols, (float)20), (float)rows-20);
-    const int y1 = std::min(std::max(((float)std::rand() / RAND_MAX) * in_image_bgr.rows, (float)20), (float)cols-20);
-    const int x2 = x1 + 8;
-    const int y2 = y1 + 8;
+    CHECK(!bReducedPrecision) << "binary_ip1 can't be combined with " << FLAGS_precision << " precision";
+    CHECK_EQ(nets[0]->input_blobs()[0]->num_axes(), 2) << "Only the first layer of the patch net can be binary";
+    binary_ip.reset(new BinaryInnerProduct(*nets[0]));
+  }
+  options.binary_ip = binary_ip.get();
+  options.dirty = NULL;
+  options.labels = NULL;
 
-    cv::rectangle(in_image_bgr,
-      cv::Point(x1, y1),
-      cv::Point(x2, y2),
-      cv::Scalar(0, 0, 255),
-      -1,
-      8);
+  // times the layers and stages when asked
+  boost::scoped_ptr<Profiler> profiler;
+  if (!FLAGS_profile.empty())
+  {
+    profiler.reset(new Profiler());
   }
+  options.profiler = profiler.get();
 
-  // 3 circles (green)
-  for (int i = 0; i < 3; i++)
+  if (FLAGS_server)
   {
-    const int x1 = std::min(std::max(((float)std::rand() / RAND_MAX) * in_image_bgr.cols, (float)20), (float)rows-20);
-    const int y1 = std::min(std::max(((float)std::rand() / RAND_MAX) * in_image_bgr.rows, (float)20), (float)cols-20);
-    cv::circle(in_image_bgr,
-      cv::Point(x1, y1),
-      5,
-      cv::Scalar(0, 255, 0),
-      -1,
-      8);
+    LineServer server(FLAGS_socket, FLAGS_max_batch);
+    log << "serving " << (FLAGS_socket.empty() ? "stdin" : FLAGS_socket) << std::endl;
+    server.Run(boost::bind(&ServeRequests, &nets, &mlps, &options, kernel, _1, _2));
+    if (profiler)
+    {
+      profiler->Write(FLAGS_profile, log);
+    }
+    return 0;
   }
 
-  // binarize for classification
-  cv::Mat in_image_gray;
-  cv::cvtColor(in_image_bgr, in_image_gray, CV_RGB2GRAY);
-  cv::Mat in_image = in_image_gray > 0;
+  if (!FLAGS_image.empty())
+  {
+    log << "classifying " << FLAGS_image << " in bands of " << FLAGS_band_rows << " rows" << std::endl;
+    caffe::CPUTimer wall_timer;
+    wall_timer.Start();
+    tCounts counts;
+    int iBands = 0;
+    ClassifyBands(nets, mlps, options, kernel, FLAGS_image, FLAGS_result, FLAGS_band_rows, &counts, &iBands);
+    const double dSeconds = wall_timer.Seconds();
 
-  // show input
-  cv::namedWindow("in", CV_WINDOW_AUTOSIZE);
-  cv::moveWindow("in", 20, 20);
-  cv::imshow("in", in_image);
+    PrintFileCounts(counts);
+    std::cout << "classified " << counts.iProcessedPixels << " pixels in " << iBands << " bands in " << dSeconds << " s ("
+              << (dSeconds > 0 ? counts.iProcessedPixels / dSeconds : 0) << " pixels per second)" << std::endl;
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+      std::cout << "peak memory: " << usage.ru_maxrss / 1024 << " MB" << std::endl;
+    }
+    if (profiler)
+    {
+      profiler->Write(FLAGS_profile, std::cout);
+    }
+    return 0;
+  }
 
-  // create output image
-  cv::Mat out_image_bgr = cv::Mat::zeros(in_image.size(), CV_8UC3);
+  if (!FLAGS_output_dir.empty())
+  {
+    boost::filesystem::create_directories(FLAGS_output_dir);
+  }
 
-  // three outputs; either 0 (background), 1 (circle) or 2 (square)
-  const int iNumOfOutputs = 3;
+  if (!FLAGS_sequence.empty())
+  {
+    CHECK_EQ(nets[0]->input_blobs()[0]->num_axes(), 2) << "Only the patch net can classify parts of a frame";
+    CHECK(!FLAGS_compare_fp32) << "A sequence can't be compared with the fp32 net";
 
-  // create network input data
-  long iProcessedPixels = 0;
-  long iPixelsClass0 = 0, iPixelsClass1 = 0, iPixelsClass2 = 0;
-  long iCorrectPixelsClass0 = 0, iCorrectPixelsClass1 = 0, iCorrectPixelsClass2 = 0;
-  const int kernel = 15;
-  const int h_kernel = kernel / 2;
-  for (int y = h_kernel; y < in_image.rows - h_kernel; y++)
-  {
-    // create input blob for a whole line which is much faster (instead of a classification per pixel)
-    caffe::BlobProto blob_proto;
-    caffe::BlobShape* shape = blob_proto.mutable_shape();
-    shape->add_dim(cols - 2 * h_kernel);
-    shape->add_dim(kernel * kernel);
-
-    for (int x = h_kernel; x < in_image.cols - h_kernel; x++)
-    {
-      // keep track of some counts for statistics
-      iProcessedPixels++;
-      const cv::Vec3b color = in_image_bgr.at<cv::Vec3b>(y, x);
-      if (color == cv::Vec3b(0, 0, 0))
-        iPixelsClass0++;
-      else if (color == cv::Vec3b(0, 255, 0))
-        iPixelsClass1++;
-      else if (color == cv::Vec3b(0, 0, 255))
-        iPixelsClass2++;
-
-      // create data
-      for (int yk = y - h_kernel; yk < y + h_kernel + 1; yk++)
+    // the frames are the files of the directory in name order
+    std::vector<std::string> vFrames;
+    for (boost::filesystem::directory_iterator it(FLAGS_sequence); it != boost::filesystem::directory_iterator(); ++it)
+    {
+      if (boost::filesystem::is_regular_file(it->status()))
       {
-        for (int xk = x - h_kernel; xk < x + h_kernel + 1; xk++)
-        {
-          const uchar val = in_image.at<uchar>(yk, xk);
-          blob_proto.add_data(val / 255.0f);
-        }
+        vFrames.push_back(it->path().string());
       }
     }
+    std::sort(vFrames.begin(), vFrames.end());
+    CHECK(!vFrames.empty()) << "No frames in " << FLAGS_sequence;
 
-    // create blob of correct size
-    std::vector<int> vShape;
-    vShape.push_back(cols - 2 * h_kernel);
-    vShape.push_back(kernel * kernel);
-    caffe::Blob<float> blob(vShape);
+    log << "classifying " << vFrames.size() << " frames of " << FLAGS_sequence << std::endl;
+    tCounts counts;
+    const double dSeconds = ClassifySequence(nets, mlps, options, kernel, vFrames, FLAGS_output_dir, &counts);
+    PrintFileCounts(counts);
+    std::cout << "classified " << 100 - static_cast<double>(counts.iCachedPixels) / counts.iProcessedPixels * 100
+              << "% of the pixels of all frames again" << std::endl;
+    std::cout << "classified " << vFrames.size() << " frames in " << dSeconds << " s ("
+              << (dSeconds > 0 ? vFrames.size() / dSeconds : 0) << " frames per second)" << std::endl;
+    if (profiler)
+    {
+      profiler->Write(FLAGS_profile, std::cout);
+    }
+    return 0;
+  }
+
+  // a benchmark first classifies some images that are not measured
+  if (FLAGS_benchmark || FLAGS_evaluate)
+  {
+    FLAGS_headless = true;
+  }
+  const int iWarmupImages = FLAGS_benchmark ? FLAGS_warmup_images : 0;
+
+  // time measurements of every stage, per image
+  tStageTimes generate_times, binarize_times, extract_times, forward_times, postprocess_times, wall_times;
+  caffe::CPUTimer timer, wall_timer;
 
-    // set data into blob
-    blob.FromProto(blob_proto);
+  // seed random generator
+  boost::mt19937 rng(std::time(NULL));
 
-    // fill the bottom vector
-    std::vector<caffe::Blob<float>*> bottom;
-    bottom.push_back(&blob);
+  // the net is created once and classifies all images
+  tCounts counts;
+  for (int n = -iWarmupImages; n < FLAGS_num_images; n++)
+  {
+    // generate random input image
+    const int rows = 200;
+    const int cols = 200;
+    timer.Start();
+    Profiler::Stage stage(profiler.get());
+    stage.Start("generate");
+    const cv::Mat in_image_bgr = GenerateRandomShapeImage(rows, cols, &rng);
+    const double dGenerateTime = timer.MilliSeconds();
 
-    // forward pass
-    float loss = 0.0;
-    const std::vector<caffe::Blob<float>*>& result = caffe_test_net.Forward(bottom, &loss);
+    // binarize for classification
+    wall_timer.Start();
+    timer.Start();
+    stage.Start("binarize");
+    cv::Mat in_image_gray;
+    cv::cvtColor(in_image_bgr, in_image_gray, CV_RGB2GRAY);
+    cv::Mat in_image = in_image_gray > 0;
+    stage.Stop();
+    const double dBinarizeTime = timer.MilliSeconds();
 
-    // mark classification result in output image
-    for (int x = h_kernel, batch = 0; x < in_image.cols - h_kernel - 1; x++, batch++)
+    // show input
+    if (!FLAGS_headless)
     {
-      // find maximum
-      float max = -1;
-      int max_i = -1;
-      for (int i = 0; i < iNumOfOutputs; ++i)
-      {
-        const float value = (result[0]->cpu_data())[i + batch * iNumOfOutputs];
-        if (value > max)
-        {
-          max = value;
-          max_i = i;
-        }
-      }
+      cv::namedWindow("in", CV_WINDOW_AUTOSIZE);
+      cv::moveWindow("in", 20, 20);
+      cv::imshow("in", in_image);
+    }
 
-      // draw classification result in output image
-      switch (max_i)
-      {
-        case 0: // class 0: background
-          out_image_bgr.at<cv::Vec3b>(y, x) = cv::Vec3b(0, 0, 0);
-          if (out_image_bgr.at<cv::Vec3b>(y, x) == in_image_bgr.at<cv::Vec3b>(y, x))
-            iCorrectPixelsClass0++;
-          break;
-        case 1: // class 1: circle
-          out_image_bgr.at<cv::Vec3b>(y, x) = cv::Vec3b(0, 255, 0);
-          if (out_image_bgr.at<cv::Vec3b>(y, x) == in_image_bgr.at<cv::Vec3b>(y, x))
-            iCorrectPixelsClass1++;
-          break;
-        case 2: // class 2: square
-          out_image_bgr.at<cv::Vec3b>(y, x) = cv::Vec3b(0, 0, 255);
-          if (out_image_bgr.at<cv::Vec3b>(y, x) == in_image_bgr.at<cv::Vec3b>(y, x))
-            iCorrectPixelsClass2++;
-          break;
-        default:
-          break;
-      }
+    cv::Mat out_image_bgr;
+    tCounts image_counts;
+    ClassifyImage(nets, mlps, options, kernel, in_image_bgr, in_image, &out_image_bgr, &image_counts);
+    const double dWallTime = wall_timer.MilliSeconds();
+
+    // warm up images don't count
+    if (n < 0)
+    {
+      continue;
+    }
+    counts.add(image_counts);
+    generate_times.vTimes.push_back(dGenerateTime);
+    binarize_times.vTimes.push_back(dBinarizeTime + image_counts.dBinarizeTime);
+    extract_times.vTimes.push_back(image_counts.dExtractTime);
+    forward_times.vTimes.push_back(image_counts.dForwardTime);
+    postprocess_times.vTimes.push_back(image_counts.dPostprocessTime);
+    wall_times.vTimes.push_back(dWallTime);
+
+    if (FLAGS_num_images > 1 && !FLAGS_benchmark && !FLAGS_evaluate)
+    {
+      std::cout << "image " << n << ": classified " <<
+        static_cast<double>(image_counts.correct()) / image_counts.iProcessedPixels * 100
+        << "% in total correctly" << std::endl;
+    }
+
+    // write input and result
+    if (!FLAGS_output_dir.empty())
+    {
+      std::stringstream ss;
+      ss << FLAGS_output_dir << "/" << std::setw(6) << std::setfill('0') << n;
+      cv::imwrite(ss.str() + "-in.png", in_image_bgr);
+      cv::imwrite(ss.str() + "-result.png", out_image_bgr);
+    }
+
+    // show result
+    if (!FLAGS_headless)
+    {
+      cv::namedWindow("result", CV_WINDOW_AUTOSIZE);
+      cv::moveWindow("result", 240, 20);
+      cv::imshow("result", out_image_bgr);
+      cv::waitKey(0);
     }
   }
 
-  std::cout << "classified " << static_cast<double>(iCorrectPixelsClass0) / iPixelsClass0 * 100 << "% correctly in class 0" << std::endl;
-  std::cout << "classified " << static_cast<double>(iCorrectPixelsClass1) / iPixelsClass1 * 100 << "% correctly in class 1" << std::endl;
-  std::cout << "classified " << static_cast<double>(iCorrectPixelsClass2) / iPixelsClass2 * 100 << "% correctly in class 2" << std::endl;
-  std::cout << "classified " <<
-    static_cast<double>(iCorrectPixelsClass0 + iCorrectPixelsClass1 + iCorrectPixelsClass2) / iProcessedPixels * 100
-    << "% in total correctly" << std::endl;
+  if (FLAGS_evaluate)
+  {
+    PrintEvaluation(counts, FLAGS_num_images, wall_times.total() / 1000, log);
+  }
+  else
+  {
+    PrintCounts(counts, log);
+  }
+  if (bReducedPrecision && FLAGS_compare_fp32)
+  {
+    PrintComparison(FLAGS_precision, counts, log);
+  }
+  else if (FLAGS_binary_ip1 && FLAGS_compare_fp32)
+  {
+    PrintComparison("binary ip1", counts, log);
+  }
+
+  if (FLAGS_benchmark)
+  {
+    // all stages; the classification stages are thread time, total is the wall time to classify an image
+    std::vector<std::pair<std::string, tStageTimes> > stages;
+    stages.push_back(std::make_pair("generate", generate_times));
+    stages.push_back(std::make_pair("binarize", binarize_times));
+    stages.push_back(std::make_pair("extract", extract_times));
+    stages.push_back(std::make_pair("forward", forward_times));
+    stages.push_back(std::make_pair("postprocess", postprocess_times));
+    stages.push_back(std::make_pair("total", wall_times));
 
-  cv::namedWindow("result", CV_WINDOW_AUTOSIZE);
-  cv::moveWindow("result", 240, 20);
-  cv::imshow("result", out_image_bgr);
-  cv::waitKey(0);
+    if (FLAGS_benchmark_file.empty())
+    {
+      WriteBenchmark(std::cout, stages, wall_times, counts, load_timer.MilliSeconds());
+    }
+    else
+    {
+      std::ofstream benchmark_file(FLAGS_benchmark_file.c_str());
+      CHECK(benchmark_file.good()) << "Cannot write " << FLAGS_benchmark_file;
+      WriteBenchmark(benchmark_file, stages, wall_times, counts, load_timer.MilliSeconds());
+    }
+  }
+  if (profiler)
+  {
+    profiler->Write(FLAGS_profile, log);
+  }
 
   return 0;
 }
@@ -0,0 +1,101 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+// This program converts a trained model of the (patch) network into a trained model
+// of the equivalent fully convolutional network.
+// Every InnerProduct layer becomes a Convolution layer with the same weights; the
+// first one uses a kernel x kernel kernel, the others a 1 x 1 kernel. The memory
+// layout of the weights is the same for both, so they can be copied as they are.
+// Usage:
+//  convert-shape-to-fcn NET MODEL FCN_NET FCN_MODEL
+//
+
+#include <gflags/gflags.h>
+#include <caffe/caffe.hpp>
+#include <caffe/util/io.hpp>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// returns the layers of net of the given type, in order
+static std::vector<caffe::Layer<float>*>
+LayersOfType(const caffe::Net<float>& net, const std::string& type)
+{
+  std::vector<caffe::Layer<float>*> layers;
+  for (size_t i = 0; i < net.layers().size(); i++)
+  {
+    if (type == net.layers()[i]->type())
+    {
+      layers.push_back(net.layers()[i].get());
+    }
+  }
+  return layers;
+}
+
+int
+main(int argc, char* argv[])
+{
+  ::google::InitGoogleLogging(argv[0]);
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Converts a trained model into a trained model of the equivalent fully convolutional network\n"
+                          "Usage:\n"
+                          " convert-shape-to-fcn NET MODEL FCN_NET FCN_MODEL\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 5)
+  {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "convert-shape-to-fcn");
+    return 1;
+  }
+
+  // get the net and its trained model
+  const std::string sNetwork = argv[1];
+  const std::string sModel = argv[2];
+  std::cout << "loading " << sNetwork << " and " << sModel << std::endl;
+  caffe::Net<float> net(sNetwork, caffe::TEST);
+  net.CopyTrainedLayersFrom(sModel);
+
+  // get the fully convolutional net
+  const std::string sFcnNetwork = argv[3];
+  std::cout << "loading " << sFcnNetwork << std::endl;
+  caffe::Net<float> fcn_net(sFcnNetwork, caffe::TEST);
+
+  // the n-th InnerProduct layer becomes the n-th Convolution layer
+  const std::vector<caffe::Layer<float>*> ip_layers = LayersOfType(net, "InnerProduct");
+  const std::vector<caffe::Layer<float>*> conv_layers = LayersOfType(fcn_net, "Convolution");
+  CHECK_EQ(ip_layers.size(), conv_layers.size()) << "Both nets must have the same number of layers to convert";
+
+  for (size_t i = 0; i < ip_layers.size(); i++)
+  {
+    // copy weights and bias
+    std::vector<boost::shared_ptr<caffe::Blob<float> > >& ip_blobs = ip_layers[i]->blobs();
+    std::vector<boost::shared_ptr<caffe::Blob<float> > >& conv_blobs = conv_layers[i]->blobs();
+    CHECK_EQ(ip_blobs.size(), conv_blobs.size()) << "Layer " << conv_layers[i]->layer_param().name() << " must have a bias when "
+                                                  << ip_layers[i]->layer_param().name() << " has one";
+    for (size_t j = 0; j < ip_blobs.size(); j++)
+    {
+      CHECK_EQ(ip_blobs[j]->count(), conv_blobs[j]->count()) << "Layer " << conv_layers[i]->layer_param().name()
+                                                             << " does not match " << ip_layers[i]->layer_param().name();
+      std::copy(ip_blobs[j]->cpu_data(), ip_blobs[j]->cpu_data() + ip_blobs[j]->count(), conv_blobs[j]->mutable_cpu_data());
+    }
+
+    std::cout << "converted " << ip_layers[i]->layer_param().name() << " (" << ip_blobs[0]->shape_string() << ") to "
+              << conv_layers[i]->layer_param().name() << " (" << conv_blobs[0]->shape_string() << ")" << std::endl;
+  }
+
+  // save the trained fully convolutional model
+  const std::string sFcnModel = argv[4];
+  std::cout << "saving " << sFcnModel << std::endl;
+  caffe::NetParameter net_param;
+  fcn_net.ToProto(&net_param);
+  caffe::WriteProtoToBinaryFile(net_param, sFcnModel);
+
+  return 0;
+}
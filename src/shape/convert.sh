@@ -0,0 +1,3 @@
+#!/usr/bin/env sh
+
+../../build/src/shape/convert-shape-to-fcn deploy.prototxt snapshot_iter_10000.caffemodel deploy-fcn.prototxt snapshot_iter_10000_fcn.caffemodel
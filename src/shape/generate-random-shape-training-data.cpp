@@ -11,7 +11,10 @@
 //
 
 #include <gflags/gflags.h>
-#include <boost/scoped_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/thread.hpp>
 #include <caffe/proto/caffe.pb.h>
 #include <caffe/util/db.hpp>
 #include <caffe/util/io.hpp>
@@ -20,15 +23,111 @@
 #include <vector>
 #include <algorithm>
 #include <ctime>
+#include <iomanip>
+#include <map>
+#include <sstream>
 
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include "patch-extractor.hpp"
+#include "random-shape-image.hpp"
+#include "sample-writer.hpp"
+#include "shuffle-buffer.hpp"
+
 // define gflags FLAGS and default values
 DEFINE_string(backend, "lmdb", "The backend {lmdb, leveldb} for storing the result");
 DEFINE_int32(split, 1, "Number of samples {nr} used for TRAIN before a sample is used for TEST, use negative value to do the opposite");
 DEFINE_bool(shuffle, true, "Randomly shuffle the order of samples");
 DEFINE_bool(balance, false, "Create a balanced set");
+DEFINE_bool(headless, false, "Don't show the image and don't wait for a key press, so it can run without a display");
+DEFINE_string(output_dir, "", "Directory where the generated images are written to, nothing is written when empty");
+DEFINE_int32(num_images, 1, "Number of random images {nr} to generate samples from");
+DEFINE_int32(threads, 1, "Number of threads {nr} that generate images in parallel");
+DEFINE_string(encoding, "float", "How the sample data is stored {float, uint8}; uint8 stores each 0 or 1 in a single byte of Datum::data, which the Data layer reads as the same 0.0 or 1.0");
+DEFINE_int32(shuffle_buffer, 100000, "Number of samples {nr} kept in memory for shuffling, the order is completely random when all samples fit");
+DEFINE_int32(shards, 1, "Number of databases {nr} per TRAIN and TEST split");
+DEFINE_int32(queue_size, 10000, "Number of samples {nr} that can wait to be written to the DB");
+DEFINE_int32(commit_samples, 1000, "Commit to the DB after {nr} samples, 0 for no limit");
+DEFINE_int32(commit_mb, 64, "Commit to the DB after {nr} MB, 0 for no limit");
+DEFINE_int32(seed, -1, "Seed {nr} for the random generators, the same seed gives the same samples for any number of threads; use a negative value to seed with the current time");
+
+// generated data
+typedef float tInput;
+typedef std::vector<tInput> tData;
+typedef int tLabel;
+typedef std::pair<std::string, tLabel> tSample; // serialized caffe::Datum and its label
+typedef std::vector<tSample> tSamples;
+
+// Generates a random image and the (serialized) samples from it. Every image has its own random
+// generator seeded with seed + iImage, so the result doesn't depend on the thread
+// that generates it, or on the order in which images are generated.
+static void
+GenerateImageSamples(const unsigned int seed, const int iImage, tSamples* samples, cv::Mat* image_bgr)
+{
+  boost::mt19937 rng(seed + iImage);
+
+  // generate image
+  const int rows = 200;
+  const int cols = 200;
+  const cv::Mat in_image_bgr = GenerateRandomShapeImage(rows, cols, &rng);
+  if (image_bgr != NULL)
+  {
+    *image_bgr = in_image_bgr;
+  }
+
+  if (!FLAGS_output_dir.empty())
+  {
+    std::stringstream ss;
+    ss << FLAGS_output_dir << "/" << std::setw(6) << std::setfill('0') << iImage << "-in.png";
+    cv::imwrite(ss.str(), in_image_bgr);
+  }
+
+  // generate training data from input image
+  const int kernel = 15;
+  const PatchExtractor extractor(in_image_bgr, kernel);
+  std::vector<cv::Point> pixels;
+  std::vector<int> labels;
+  SelectShapeSamples(in_image_bgr, kernel, FLAGS_balance, &pixels, &labels);
+  tData data(extractor.patch_size());
+  const bool bUint8 = (FLAGS_encoding == "uint8");
+  for (size_t iSample = 0; iSample < pixels.size(); iSample++)
+  {
+    const tLabel label = labels[iSample];
+
+    // the patch around the pixel is the (binarized) input data of the sample
+    extractor.Extract(pixels[iSample].x, pixels[iSample].y, &data[0]);
+
+    // convert sample to protobuf Datum
+    caffe::Datum datum;
+    datum.set_channels(data.size());
+    datum.set_height(1);
+    datum.set_width(1);
+    datum.set_label(label);
+    if (bUint8)
+    {
+      // binary values fit in a byte, 1 byte per value instead of 4 bytes plus a tag
+      std::string* pBytes = datum.mutable_data();
+      pBytes->resize(data.size());
+      for (size_t i = 0; i < data.size(); i++)
+      {
+        (*pBytes)[i] = static_cast<char>(data[i]);
+      }
+    }
+    else
+    {
+      for (tData::const_iterator itrInputData = data.begin()
+                               ; itrInputData != data.end()
+                               ; ++itrInputData)
+      {
+        datum.add_float_data(*itrInputData);
+      }
+    }
+
+    samples->push_back(std::make_pair(std::string(), label));
+    CHECK(datum.SerializeToString(&samples->back().first));
+  }
+}
 
 int
 main(int argc, char* argv[])
@@ -45,157 +144,89 @@ main(int argc, char* argv[])
                           " generate-random-shape-training-data [FLAGS] DB_NAME\n");
   gflags::ParseCommandLineFlags(&argc, &argv, true);
 
-  if (argc != 2)
+  if (argc != 2 || FLAGS_num_images < 1 || FLAGS_threads < 1 || FLAGS_shards < 1 ||
+      (FLAGS_encoding != "float" && FLAGS_encoding != "uint8"))
   {
     gflags::ShowUsageWithFlagsRestrict(argv[0], "generate-random-shape-training-data");
     return 1;
   }
 
-  // seed random generator
-  std::srand(std::time(NULL));
+  // seed random generators
+  const unsigned int seed = (FLAGS_seed < 0) ? static_cast<unsigned int>(std::time(NULL)) : FLAGS_seed;
+  std::cout << "seed: " << seed << std::endl;
 
-  // generate random data
-  typedef float tInput;
-  typedef std::vector<tInput> tData;
-  typedef int tLabel;
-  typedef std::pair<tData, tLabel> tSample;
-  typedef std::vector<tSample> tSamples;
-  tSamples samples;
+  if (!FLAGS_output_dir.empty())
+  {
+    boost::filesystem::create_directories(FLAGS_output_dir);
+  }
 
-  { // create random input
-    // generate image
-    const int rows = 200;
-    const int cols = 200;
-    cv::Mat in_image_bgr = cv::Mat::zeros(rows, cols, CV_8UC3);
+  // the samples are written to the train and test DB by a writer thread, on the way
+  // there they are shuffled in a buffer of limited size
+  SampleWriter writer(FLAGS_backend, argv[1], FLAGS_split, FLAGS_shards, FLAGS_queue_size,
+                      FLAGS_commit_samples, static_cast<size_t>(FLAGS_commit_mb) << 20);
+  ShuffleBuffer<tSample> shuffle_buffer(FLAGS_shuffle_buffer, seed);
 
-    // square (red)
-    for (int i = 0; i < 3; i++)
+  // generate random data, a number of images (one per thread) at a time so only the samples
+  // of those images are in memory
+  std::cout << "generating training data from " << FLAGS_num_images << " image(s)..." << std::endl;
+  typedef std::map<int, int> tCounts;
+  tCounts counts;
+  std::vector<tSamples> image_samples(FLAGS_threads);
+  tSample shuffled;
+  for (int iFirstImage = 0; iFirstImage < FLAGS_num_images; iFirstImage += FLAGS_threads)
+  {
+    const int iImages = std::min(FLAGS_threads, FLAGS_num_images - iFirstImage);
+    cv::Mat first_image_bgr;
+    boost::thread_group threads;
+    for (int i = 0; i < iImages; i++)
     {
-      const int x1 = std::min(std::max(((float)std::rand() / RAND_MAX) * in_image_bgr.cols, (float)20), (float)rows-20);
-      const int y1 = std::min(std::max(((float)std::rand() / RAND_MAX) * in_image_bgr.rows, (float)20), (float)cols-20);
-      const int x2 = x1 + 8;
-      const int y2 = y1 + 8;
-
-      cv::rectangle(in_image_bgr,
-        cv::Point(x1, y1),
-        cv::Point(x2, y2),
-        cv::Scalar(0, 0, 255),
-        -1,
-        8);
+      tSamples().swap(image_samples[i]);
+      threads.create_thread(boost::bind(&GenerateImageSamples,
+                                        seed,
+                                        iFirstImage + i,
+                                        &image_samples[i],
+                                        (iFirstImage + i == 0) ? &first_image_bgr : NULL));
     }
+    threads.join_all();
 
-    // circle (green)
-    for (int i = 0; i < 3; i++)
+    if (iFirstImage == 0 && !FLAGS_headless)
     {
-      const int x1 = std::min(std::max(((float)std::rand() / RAND_MAX) * in_image_bgr.cols, (float)20), (float)rows-20);
-      const int y1 = std::min(std::max(((float)std::rand() / RAND_MAX) * in_image_bgr.rows, (float)20), (float)cols-20);
-      cv::circle(in_image_bgr,
-        cv::Point(x1, y1),
-        5,
-        cv::Scalar(0, 255, 0),
-        -1,
-        8);
+      cv::namedWindow("in_image_bgr", CV_WINDOW_AUTOSIZE);
+      cv::moveWindow("in_image_bgr", 20, 20);
+      cv::imshow("in_image_bgr", first_image_bgr);
     }
 
-    cv::namedWindow("in_image_bgr", CV_WINDOW_AUTOSIZE);
-    cv::moveWindow("in_image_bgr", 20, 20);
-    cv::imshow("in_image_bgr", in_image_bgr);
-
-    std::cout << "generating training data from image..." << std::endl;
-
-    // generate training data from input image
-    const int kernel = 15;
-    const int h_kernel = kernel / 2;
-    int iBackgroundCount = 0;
-    for (int y = h_kernel; y < in_image_bgr.rows - h_kernel; y++)
+    // pass the samples on in image order
+    for (int i = 0; i < iImages; i++)
     {
-      for (int x = h_kernel; x < in_image_bgr.cols - h_kernel; x++)
+      for (tSamples::const_iterator itrSample = image_samples[i].begin()
+                                  ; itrSample != image_samples[i].end()
+                                  ; ++itrSample)
       {
-        const cv::Vec3b vec = in_image_bgr.at<cv::Vec3b>(y, x);
-        if (vec[1] > 0) // circle
+        // count classes and number of occurences
+        counts[itrSample->second]++;
+
+        // randomly shuffle samples
+        if (FLAGS_shuffle == false)
         {
-          const tLabel label = 1;
-          tData data;
-          for (int yk = y - h_kernel; yk < y + h_kernel + 1; yk++)
-          {
-            for (int xk = x - h_kernel; xk < x + h_kernel + 1; xk++)
-            {
-              const cv::Vec3b veck = in_image_bgr.at<cv::Vec3b>(yk, xk);
-              if (veck[1] > 0 || veck[2] > 0 || veck[0] > 0) // binarize
-                data.push_back(1.0f);
-              else
-                data.push_back(0.0f);
-            }
-          }
-          samples.push_back(std::make_pair(data, label));
+          writer.Put(itrSample->first, itrSample->second);
         }
-        else if (vec[2] > 0) // square
+        else if (shuffle_buffer.Add(*itrSample, &shuffled))
         {
-          const tLabel label = 2;
-          tData data;
-          for (int yk = y - h_kernel; yk < y + h_kernel + 1; yk++)
-          {
-            for (int xk = x - h_kernel; xk < x + h_kernel + 1; xk++)
-            {
-              const cv::Vec3b veck = in_image_bgr.at<cv::Vec3b>(yk, xk);
-              if (veck[1] > 0 || veck[2] > 0 || veck[0] > 0) // binarize
-                data.push_back(1.0f);
-              else
-                data.push_back(0.0f);
-            }
-          }
-          samples.push_back(std::make_pair(data, label));
-        }
-        else // background
-        {
-          // if balance is true, the background samples that are added are mostly around the
-          // squares and circles and some (but not all) others
-          if (FLAGS_balance == true)
-          {
-            bool bHasNeighbourObject = false;
-            const cv::Vec3b vec_h1 = in_image_bgr.at<cv::Vec3b>(y, x-1);
-            const cv::Vec3b vec_h2 = in_image_bgr.at<cv::Vec3b>(y, x+1);
-            const cv::Vec3b vec_v1 = in_image_bgr.at<cv::Vec3b>(y-1, x);
-            const cv::Vec3b vec_v2 = in_image_bgr.at<cv::Vec3b>(y+1, x);
-            if (vec_h1[1] > 0 || vec_h1[2] > 0 || vec_v1[1] > 0 || vec_v1[2] > 0 ||
-                vec_h2[1] > 0 || vec_h2[2] > 0 || vec_v2[1] > 0 || vec_v2[2] > 0)
-            {
-              bHasNeighbourObject = true;
-            }
-
-            iBackgroundCount++;
-            // only take a part of the background and when background is near objects
-            if (bHasNeighbourObject == false && iBackgroundCount % 50 != 0)
-              continue;
-          }
-          const tLabel label = 0;
-          tData data;
-          for (int yk = y - h_kernel; yk < y + h_kernel + 1; yk++)
-          {
-            for (int xk = x - h_kernel; xk < x + h_kernel + 1; xk++)
-            {
-              const cv::Vec3b veck = in_image_bgr.at<cv::Vec3b>(yk, xk);
-              if (veck[1] > 0 || veck[2] > 0 || veck[0] > 0) // binarize
-                data.push_back(1.0f);
-              else
-                data.push_back(0.0f);
-            }
-          }
-          samples.push_back(std::make_pair(data, label));
+          writer.Put(shuffled.first, shuffled.second);
         }
       }
     }
   }
 
-  // count classes and number of occurences
-  typedef std::map<int, int> tCounts;
-  tCounts counts;
-  for (tSamples::const_iterator itrSample = samples.begin()
-                              ; itrSample != samples.end()
-                              ; ++itrSample)
+  // write the samples that are still in the shuffle buffer
+  std::vector<tSample> remaining;
+  shuffle_buffer.Flush(&remaining);
+  for (size_t i = 0; i < remaining.size(); i++)
   {
-    counts[itrSample->second]++;
+    writer.Put(remaining[i].first, remaining[i].second);
   }
+  writer.Close();
 
   // show counts
   for (tCounts::const_iterator itr = counts.begin()
@@ -205,131 +236,16 @@ main(int argc, char* argv[])
     std::cout << "class: " << itr->first << " count: " << itr->second << std::endl;
   }
 
-  // shuffle the data
-  if (FLAGS_shuffle == true)
+  std::cout << "Total of " << writer.count() << " samples generated, put " << writer.count_train() << " to TRAIN DB and " << writer.count_test() << " to TEST DB" << std::endl;
+  std::cout << "Written " << writer.bytes() / 1048576.0 << " MB in " << writer.commits() << " commits, " << writer.write_seconds() << " seconds writing the databases";
+  if (writer.write_seconds() > 0) // 0 when nothing was written or it was too fast to time
   {
-    // randomly shuffle samples
-    std::random_shuffle(samples.begin(), samples.end());
+    std::cout << " (" << writer.bytes() / 1048576.0 / writer.write_seconds() << " MB/s)";
   }
-
-  // Create new train and test DB
-  boost::scoped_ptr<caffe::db::DB> train_db(caffe::db::GetDB(FLAGS_backend));
-  std::string dbTrainName = argv[1];
-  dbTrainName += "_train";
-  train_db->Open(dbTrainName.c_str(), caffe::db::NEW);
-  boost::scoped_ptr<caffe::db::Transaction> train_txn(train_db->NewTransaction());
-
-  boost::scoped_ptr<caffe::db::DB> test_db(caffe::db::GetDB(FLAGS_backend));
-  std::string dbTestName = argv[1];
-  dbTestName += "_test";
-  test_db->Open(dbTestName.c_str(), caffe::db::NEW);
-  boost::scoped_ptr<caffe::db::Transaction> test_txn(test_db->NewTransaction());
-
-  // divide the train/test data, determine spliting tactic
-  const int iSplitRate = FLAGS_split;
-  int iNumberPutToTrain = 0;
-  int iNumberPutToTest = 0;
-  enum eNextSample {eNSTrain, eNSTest};
-  eNextSample nextSample = eNSTrain; // always start with train samples
-
-  // convert samples to caffe::Datum
-  int iCount = 0, iCountTrain = 0, iCountTest = 0;
-  for (tSamples::const_iterator itrSample = samples.begin()
-                              ; itrSample != samples.end()
-                              ; ++itrSample)
+  std::cout << ", " << writer.seconds() << " seconds end-to-end" << std::endl;
+  if (!FLAGS_headless)
   {
-    // extract label from sample
-    const int iLabel = itrSample->second;
-
-    // convert sample to protobuf Datum
-    caffe::Datum datum;
-    datum.set_channels(itrSample->first.size());
-    datum.set_height(1);
-    datum.set_width(1);
-    datum.set_label(iLabel);
-    for (tData::const_iterator itrInputData = itrSample->first.begin()
-                             ; itrInputData != itrSample->first.end()
-                             ; ++itrInputData)
-    {
-      datum.add_float_data(*itrInputData);
-    }
-
-    // write datum to db use the sample number as key for db
-    std::string out;
-    CHECK(datum.SerializeToString(&out));
-    std::stringstream ss;
-    ss << iCount;
-
-    // put sample
-    if (nextSample == eNSTrain) // always start with train samples
-    {
-      train_txn->Put(ss.str(), out);
-      iNumberPutToTrain++;
-      iCountTrain++;
-    }
-    else if (nextSample == eNSTest)
-    {
-      test_txn->Put(ss.str(), out);
-      iNumberPutToTest++;
-      iCountTest++;
-    }
-
-    // determine where next sample should go
-    if (iSplitRate == 0)
-    {
-      nextSample = eNSTrain;
-    }
-    else if (iSplitRate < 0)
-    {
-      if (iNumberPutToTest == std::abs(iSplitRate))
-      {
-        nextSample = eNSTrain;
-        iNumberPutToTest = 0;
-      }
-      else
-      {
-        nextSample = eNSTest;
-      }
-    }
-    else if (iSplitRate > 0)
-    {
-      if (iNumberPutToTrain == iSplitRate)
-      {
-        nextSample = eNSTest;
-        iNumberPutToTrain = 0;
-      }
-      else
-      {
-        nextSample = eNSTrain;
-      }
-    }
-
-    // every 1000 samples commit to db
-    if (iCountTrain % 1000 == 0)
-    {
-      train_txn->Commit();
-      train_txn.reset(train_db->NewTransaction());
-    }
-    if (iCountTest % 1000 == 0)
-    {
-      test_txn->Commit();
-      test_txn.reset(test_db->NewTransaction());
-    }
-
-    iCount++;
-  }
-
-  // commit the last unwritten batch
-  if (iCountTrain % 1000 != 0)
-  {
-    train_txn->Commit();
+    cv::waitKey(0);
   }
-  if (iCountTest % 1000 != 0)
-  {
-    test_txn->Commit();
-  }
-
-  std::cout << "Total of " << iCount << " samples generated, put " << iCountTrain << " to TRAIN DB and " << iCountTest << " to TEST DB" << std::endl;
-  cv::waitKey(0);
   return 0;
 }
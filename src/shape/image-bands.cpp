@@ -0,0 +1,125 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#include "image-bands.hpp"
+
+#include <glog/logging.h>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <cctype>
+
+BandReader::BandReader(const std::string& path)
+  : path_(path)
+  , channels_(0)
+  , rows_(0)
+  , cols_(0)
+  , position_(0)
+{
+  file_.open(path_.c_str(), std::ios::binary);
+  CHECK(file_.good()) << "Cannot read " << path_;
+  char magic[2] = {0, 0};
+  file_.read(magic, sizeof(magic));
+  if (magic[0] == 'P' && (magic[1] == '5' || magic[1] == '6'))
+  {
+    channels_ = (magic[1] == '5') ? 1 : 3;
+    cols_ = ReadHeaderNumber();
+    rows_ = ReadHeaderNumber();
+    const int iMaxValue = ReadHeaderNumber();
+    CHECK_EQ(iMaxValue, 255) << "Only 8 bit images are supported: " << path_;
+    // a single white space character separates the header and the pixels
+    file_.get();
+    CHECK(file_.good()) << "Cannot read the header of " << path_;
+  }
+  else
+  {
+    file_.close();
+    image_ = cv::imread(path_, CV_LOAD_IMAGE_COLOR);
+    CHECK(!image_.empty()) << "Cannot read " << path_;
+    rows_ = image_.rows;
+    cols_ = image_.cols;
+  }
+}
+
+int
+BandReader::ReadHeaderNumber()
+{
+  int c = file_.get();
+  while (file_.good() && (std::isspace(c) || c == '#'))
+  {
+    if (c == '#')
+    {
+      while (file_.good() && c != '\n')
+      {
+        c = file_.get();
+      }
+    }
+    c = file_.get();
+  }
+  int iNumber = 0;
+  CHECK(std::isdigit(c)) << "Cannot read the header of " << path_;
+  while (file_.good() && std::isdigit(c))
+  {
+    iNumber = iNumber * 10 + (c - '0');
+    c = file_.get();
+  }
+  file_.unget();
+  return iNumber;
+}
+
+void
+BandReader::Read(const int lines, cv::Mat* band)
+{
+  const int iLines = std::min(lines, rows_ - position_);
+  if (iLines <= 0)
+  {
+    *band = cv::Mat();
+    return;
+  }
+
+  if (channels_ == 0)
+  {
+    *band = image_.rowRange(position_, position_ + iLines).clone();
+  }
+  else
+  {
+    cv::Mat pixels(iLines, cols_, channels_ == 1 ? CV_8UC1 : CV_8UC3);
+    for (int y = 0; y < iLines; y++)
+    {
+      file_.read(pixels.ptr<char>(y), cols_ * channels_);
+    }
+    CHECK(file_.good()) << path_ << " is truncated";
+    cv::cvtColor(pixels, *band, channels_ == 1 ? CV_GRAY2BGR : CV_RGB2BGR);
+  }
+  position_ += iLines;
+}
+
+BandWriter::BandWriter(const std::string& path, const int rows, const int cols)
+  : path_(path)
+  , rows_(rows)
+  , cols_(cols)
+  , position_(0)
+{
+  file_.open(path_.c_str(), std::ios::binary);
+  CHECK(file_.good()) << "Cannot write " << path_;
+  file_ << "P6\n" << cols_ << " " << rows_ << "\n255\n";
+}
+
+void
+BandWriter::Write(const cv::Mat& band)
+{
+  CHECK_EQ(band.cols, cols_) << "A band of " << path_ << " must have " << cols_ << " columns";
+  CHECK_LE(position_ + band.rows, rows_) << "Too many lines for " << path_;
+  cv::Mat rgb;
+  cv::cvtColor(band, rgb, CV_BGR2RGB);
+  for (int y = 0; y < rgb.rows; y++)
+  {
+    file_.write(rgb.ptr<char>(y), cols_ * 3);
+  }
+  file_.flush();
+  CHECK(file_.good()) << "Cannot write " << path_;
+  position_ += band.rows;
+}
@@ -0,0 +1,67 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#ifndef SHAPE_IMAGE_BANDS_HPP_
+#define SHAPE_IMAGE_BANDS_HPP_
+
+#include <opencv2/core/core.hpp>
+#include <fstream>
+#include <string>
+
+// Reads an image as bands of lines from top to bottom.
+// A binary PGM or PPM (P5 or P6, 8 bit) image is read line by line from the file, so
+// only the lines of a band are in memory. Other formats are decoded completely by
+// OpenCV and handed out a band at a time.
+class BandReader
+{
+public:
+  explicit BandReader(const std::string& path);
+
+  int rows() const { return rows_; }
+  int cols() const { return cols_; }
+
+  // number of lines that are read
+  int position() const { return position_; }
+
+  // Reads the next (at most) lines lines as a BGR image into band, which is empty when
+  // all lines are read
+  void Read(const int lines, cv::Mat* band);
+
+private:
+  // reads the next number of the PNM header, skipping white space and comments
+  int ReadHeaderNumber();
+
+  const std::string path_;
+  std::ifstream file_;
+  int channels_; // of a PNM file, 0 for an image decoded by OpenCV
+  cv::Mat image_;
+  int rows_;
+  int cols_;
+  int position_;
+};
+
+// Writes a BGR image as a binary PPM (P6) file band after band from top to bottom, so
+// the complete image never has to be in memory.
+class BandWriter
+{
+public:
+  BandWriter(const std::string& path, const int rows, const int cols);
+
+  // appends the lines of band, which must have cols columns
+  void Write(const cv::Mat& band);
+
+  // number of lines that are written
+  int position() const { return position_; }
+
+private:
+  const std::string path_;
+  std::ofstream file_;
+  const int rows_;
+  const int cols_;
+  int position_;
+};
+
+#endif // SHAPE_IMAGE_BANDS_HPP_
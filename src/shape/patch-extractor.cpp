@@ -0,0 +1,107 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#include "patch-extractor.hpp"
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+PatchExtractor::PatchExtractor(const cv::Mat& image, const int kernel)
+  : kernel_(kernel)
+{
+  // a pixel is foreground when any of its channels is set
+  cv::Mat any_channel;
+  if (image.channels() == 1)
+  {
+    any_channel = image;
+  }
+  else
+  {
+    std::vector<cv::Mat> channels;
+    cv::split(image, channels);
+    any_channel = channels[0];
+    for (size_t i = 1; i < channels.size(); i++)
+    {
+      cv::max(any_channel, channels[i], any_channel);
+    }
+  }
+
+  // binarize to 0.0 / 1.0 floats, which is the input the net expects
+  const cv::Mat binary = any_channel > 0;
+  binary.convertTo(binary_, CV_32F, 1.0 / 255);
+
+  // count foreground pixels, the sum of any patch is then found with 4 lookups
+  const cv::Mat foreground = binary / 255;
+  cv::integral(foreground, integral_, CV_32S);
+}
+
+bool
+PatchExtractor::IsEmpty(const int x, const int y) const
+{
+  // the integral image has one extra row and column in front
+  const int h_kernel = kernel_ / 2;
+  const int x1 = x - h_kernel, x2 = x + h_kernel + 1;
+  const int y1 = y - h_kernel, y2 = y + h_kernel + 1;
+  const int sum = integral_.at<int>(y2, x2) - integral_.at<int>(y1, x2)
+                - integral_.at<int>(y2, x1) + integral_.at<int>(y1, x1);
+  return sum == 0;
+}
+
+void
+PatchExtractor::Extract(const int x, const int y, float* data) const
+{
+  const int h_kernel = kernel_ / 2;
+  const size_t line_size = kernel_ * sizeof(float);
+  for (int yk = y - h_kernel; yk < y + h_kernel + 1; yk++)
+  {
+    std::memcpy(data, binary_.ptr<float>(yk) + x - h_kernel, line_size);
+    data += kernel_;
+  }
+}
+
+void
+PatchExtractor::Pack(const int x, const int y, boost::uint64_t* bits) const
+{
+  std::fill(bits, bits + packed_size(), 0);
+  const int h_kernel = kernel_ / 2;
+  int i = 0;
+  for (int yk = y - h_kernel; yk < y + h_kernel + 1; yk++)
+  {
+    const float* pLine = binary_.ptr<float>(yk) + x - h_kernel;
+    for (int xk = 0; xk < kernel_; xk++, i++)
+    {
+      bits[i / 64] |= static_cast<boost::uint64_t>(pLine[xk] != 0) << (i % 64);
+    }
+  }
+}
+
+void
+PatchExtractor::ExtractLines(const int y_begin, const int y_end, float* data) const
+{
+  const int h_kernel = kernel_ / 2;
+  const int size = patch_size();
+  for (int y = y_begin; y < y_end; y++)
+  {
+    for (int x = h_kernel; x < binary_.cols - h_kernel; x++)
+    {
+      Extract(x, y, data);
+      data += size;
+    }
+  }
+}
+
+void
+PatchExtractor::CopyLines(const int y_begin, const int y_end, float* data) const
+{
+  const size_t line_size = binary_.cols * sizeof(float);
+  for (int y = y_begin; y < y_end; y++)
+  {
+    std::memcpy(data, binary_.ptr<float>(y), line_size);
+    data += binary_.cols;
+  }
+}
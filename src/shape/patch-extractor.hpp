@@ -0,0 +1,64 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#ifndef SHAPE_PATCH_EXTRACTOR_HPP_
+#define SHAPE_PATCH_EXTRACTOR_HPP_
+
+#include <boost/cstdint.hpp>
+#include <opencv2/core/core.hpp>
+
+// Extracts the kernel x kernel neighbourhood (patch) around pixels of an image, like
+// im2col does for a convolution with stride 1.
+// The image is binarized only once on construction; every pixel that is not black
+// becomes 1.0 and black pixels become 0.0. After that each line of a patch is one
+// contiguous copy out of the binarized image.
+class PatchExtractor
+{
+public:
+  // image can be a color (BGR) or a single channel image
+  PatchExtractor(const cv::Mat& image, const int kernel);
+
+  int kernel() const { return kernel_; }
+
+  // number of values in one patch (kernel * kernel)
+  int patch_size() const { return kernel_ * kernel_; }
+
+  // number of 64 bit words of a packed patch
+  int packed_size() const { return (patch_size() + 63) / 64; }
+
+  // binarized image (CV_32F) the patches are extracted from
+  const cv::Mat& binary() const { return binary_; }
+
+  // Returns true when the patch around pixel (x, y) holds only background (all zeros).
+  // The patch must be completely inside the image.
+  bool IsEmpty(const int x, const int y) const;
+
+  // Writes the patch around pixel (x, y) to data, data must hold patch_size() values.
+  // The patch must be completely inside the image.
+  void Extract(const int x, const int y, float* data) const;
+
+  // Writes the patch around pixel (x, y) as bits to bits, value i of the patch is bit
+  // i % 64 of word i / 64. bits must hold packed_size() words.
+  // The patch must be completely inside the image.
+  void Pack(const int x, const int y, boost::uint64_t* bits) const;
+
+  // Writes the patches around all pixels of the image lines [y_begin, y_end) to data,
+  // one patch after another. Pixels closer than kernel / 2 to the left or right image
+  // border are skipped, so data must hold (y_end - y_begin) * (cols - 2 * (kernel / 2))
+  // patches.
+  void ExtractLines(const int y_begin, const int y_end, float* data) const;
+
+  // Writes the binarized image lines [y_begin, y_end) to data, which is the input of a
+  // fully convolutional net that slides the kernel over the image itself.
+  void CopyLines(const int y_begin, const int y_end, float* data) const;
+
+private:
+  cv::Mat binary_;
+  cv::Mat integral_; // integral image of the foreground pixel count (CV_32S)
+  int kernel_;
+};
+
+#endif // SHAPE_PATCH_EXTRACTOR_HPP_
@@ -0,0 +1,102 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#include "random-shape-image.hpp"
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <algorithm>
+
+cv::Mat
+GenerateRandomShapeImage(const int rows, const int cols, boost::mt19937* rng)
+{
+  boost::random::uniform_real_distribution<float> random(0, 1);
+  cv::Mat image_bgr = cv::Mat::zeros(rows, cols, CV_8UC3);
+
+  // 3 squares (red)
+  for (int i = 0; i < 3; i++)
+  {
+    const int x1 = std::min(std::max(random(*rng) * image_bgr.cols, (float)20), (float)cols-20);
+    const int y1 = std::min(std::max(random(*rng) * image_bgr.rows, (float)20), (float)rows-20);
+    const int x2 = x1 + 8;
+    const int y2 = y1 + 8;
+
+    cv::rectangle(image_bgr,
+      cv::Point(x1, y1),
+      cv::Point(x2, y2),
+      cv::Scalar(0, 0, 255),
+      -1,
+      8);
+  }
+
+  // 3 circles (green)
+  for (int i = 0; i < 3; i++)
+  {
+    const int x1 = std::min(std::max(random(*rng) * image_bgr.cols, (float)20), (float)cols-20);
+    const int y1 = std::min(std::max(random(*rng) * image_bgr.rows, (float)20), (float)rows-20);
+    cv::circle(image_bgr,
+      cv::Point(x1, y1),
+      5,
+      cv::Scalar(0, 255, 0),
+      -1,
+      8);
+  }
+
+  return image_bgr;
+}
+
+void
+SelectShapeSamples(const cv::Mat& image_bgr,
+                   const int kernel,
+                   const bool balance,
+                   std::vector<cv::Point>* pixels,
+                   std::vector<int>* labels)
+{
+  const int h_kernel = kernel / 2;
+  int iBackgroundCount = 0;
+  for (int y = h_kernel; y < image_bgr.rows - h_kernel; y++)
+  {
+    for (int x = h_kernel; x < image_bgr.cols - h_kernel; x++)
+    {
+      int label = 0; // background
+      const cv::Vec3b vec = image_bgr.at<cv::Vec3b>(y, x);
+      if (vec[1] > 0) // circle
+      {
+        label = 1;
+      }
+      else if (vec[2] > 0) // square
+      {
+        label = 2;
+      }
+      else // background
+      {
+        // if balance is true, the background samples that are added are mostly around the
+        // squares and circles and some (but not all) others
+        if (balance == true)
+        {
+          bool bHasNeighbourObject = false;
+          const cv::Vec3b vec_h1 = image_bgr.at<cv::Vec3b>(y, x-1);
+          const cv::Vec3b vec_h2 = image_bgr.at<cv::Vec3b>(y, x+1);
+          const cv::Vec3b vec_v1 = image_bgr.at<cv::Vec3b>(y-1, x);
+          const cv::Vec3b vec_v2 = image_bgr.at<cv::Vec3b>(y+1, x);
+          if (vec_h1[1] > 0 || vec_h1[2] > 0 || vec_v1[1] > 0 || vec_v1[2] > 0 ||
+              vec_h2[1] > 0 || vec_h2[2] > 0 || vec_v2[1] > 0 || vec_v2[2] > 0)
+          {
+            bHasNeighbourObject = true;
+          }
+
+          iBackgroundCount++;
+          // only take a part of the background and when background is near objects
+          if (bHasNeighbourObject == false && iBackgroundCount % 50 != 0)
+            continue;
+        }
+      }
+
+      pixels->push_back(cv::Point(x, y));
+      labels->push_back(label);
+    }
+  }
+}
@@ -0,0 +1,29 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+#ifndef SHAPE_RANDOM_SHAPE_IMAGE_HPP_
+#define SHAPE_RANDOM_SHAPE_IMAGE_HPP_
+
+#include <opencv2/core/core.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <vector>
+
+// Generates a black (BGR) image of rows x cols with 3 red squares and 3 green circles
+// at random positions drawn from rng, at least 20 pixels away from the border.
+// The same rng state always gives the same image.
+cv::Mat GenerateRandomShapeImage(const int rows, const int cols, boost::mt19937* rng);
+
+// Selects the pixels of a generated image that become training samples, with their
+// label: 1 for a circle (green), 2 for a square (red) and 0 for background. Pixels closer
+// than kernel / 2 to the border are skipped. With balance only the background pixels
+// next to a shape and every 50th other background pixel are selected.
+void SelectShapeSamples(const cv::Mat& image_bgr,
+                        const int kernel,
+                        const bool balance,
+                        std::vector<cv::Point>* pixels,
+                        std::vector<int>* labels);
+
+#endif // SHAPE_RANDOM_SHAPE_IMAGE_HPP_
@@ -0,0 +1,3 @@
+#!/usr/bin/env sh
+
+../../build/src/shape/train-shape solver.prototxt
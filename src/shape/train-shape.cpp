@@ -0,0 +1,51 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+// This program trains the net of a solver with random samples that are generated while
+// it trains, instead of samples read from a database.
+// Usage:
+//  train-shape [FLAGS] SOLVER
+//
+
+#include <gflags/gflags.h>
+#include <boost/bind.hpp>
+#include <vector>
+
+#include "patch-extractor.hpp"
+#include "random-shape-image.hpp"
+#include "train-in-memory.hpp"
+
+// define gflags FLAGS and default values
+DEFINE_bool(balance, true, "Take mostly the background samples around the shapes, like generate-random-shape-training-data --balance");
+
+// size of the patches
+const int kernel = 15;
+
+// Generates a random image and the samples from it
+static void
+GenerateSamples(boost::mt19937* rng, std::vector<MemoryFeed::tSample>* samples)
+{
+  const int rows = 200;
+  const int cols = 200;
+  const cv::Mat in_image_bgr = GenerateRandomShapeImage(rows, cols, rng);
+
+  const PatchExtractor extractor(in_image_bgr, kernel);
+  std::vector<cv::Point> pixels;
+  std::vector<int> labels;
+  SelectShapeSamples(in_image_bgr, kernel, FLAGS_balance, &pixels, &labels);
+  for (size_t i = 0; i < pixels.size(); i++)
+  {
+    samples->push_back(MemoryFeed::tSample(std::vector<float>(extractor.patch_size()), labels[i]));
+    extractor.Extract(pixels[i].x, pixels[i].y, &samples->back().first[0]);
+  }
+}
+
+int
+main(int argc, char* argv[])
+{
+  // the samples of an image are spread over a large shuffle buffer
+  return TrainInMemory(argc, argv, "train-shape", boost::bind(&GenerateSamples, _1, _2), kernel * kernel, 100000);
+}
@@ -7,6 +7,9 @@
 // This program classifies two values using a network and a trained model
 // Usage:
 //  classify-xor NET MODEL VALUE1 VALUE2
+//  classify-xor --server [FLAGS] NET MODEL
+//  classify-xor --input=FILE [FLAGS] NET MODEL
+//  classify-xor --packed [FLAGS] PACKED_NET ...
 //
 
 #include <gflags/gflags.h>
@@ -16,6 +19,288 @@
 #include <vector>
 #include <algorithm>
 
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <caffe/util/benchmark.hpp>
+
+#include "argmax.hpp"
+#include "line-server.hpp"
+#include "packed-net.hpp"
+#include "profiler.hpp"
+#include "quantized-mlp.hpp"
+
+// define gflags FLAGS and default values
+DEFINE_bool(server, false, "Keep the net loaded and classify requests of two values per line, read from stdin or the socket");
+DEFINE_string(socket, "", "Unix domain socket the server listens on, stdin/stdout is used when empty");
+DEFINE_int32(max_batch, 1024, "Maximum number of requests {nr} the server classifies in a single forward pass");
+DEFINE_string(input, "", "File with pairs of values to classify, - for stdin");
+DEFINE_string(input_format, "csv", "Format of the input: csv (two values per line) or binary (two native 32 bit ints per pair)");
+DEFINE_string(output, "", "File the class of every input pair is written to (one per line), - for stdout");
+DEFINE_int32(batch_size, 4096, "Number of input pairs {nr} classified in a single forward pass");
+DEFINE_string(precision, "fp32", "Precision of the net weights: fp32 (Caffe), fp16 or int8");
+DEFINE_bool(packed, false, "The net and its trained model are a single file written by pack-net, instead of NET MODEL");
+DEFINE_string(profile, "", "File a Chrome trace (JSON) of the time of every layer and stage is written to, a summary is printed as well");
+DEFINE_bool(compare_fp32, false, "Also classify the input pairs with the fp32 net and report the difference in accuracy with the reduced precision");
+
+// two outputs; either 0 or 1
+const int iNumOfOutputs = 2;
+
+typedef std::pair<int, int> tPair;
+
+// Classifies the pairs of values in a single forward pass, gives the class and the
+// iNumOfOutputs output values of every pair. With mlp the pairs are classified with
+// reduced precision instead of by net. With profiler the layers and stages are timed.
+static void
+ClassifyPairs(caffe::Net<float>* net,
+              QuantizedMlp* mlp,
+              Profiler* profiler,
+              const std::vector<tPair>& pairs,
+              std::vector<int>* labels,
+              std::vector<float>* outputs)
+{
+  Profiler::Stage stage(profiler);
+  stage.Start("fill");
+
+  // resize the input to the number of pairs
+  caffe::Blob<float>* input = net->input_blobs()[0];
+  if (input->shape(0) != static_cast<int>(pairs.size()))
+  {
+    std::vector<int> vShape;
+    vShape.push_back(pairs.size());
+    vShape.push_back(2);
+    input->Reshape(vShape);
+    net->Reshape();
+  }
+
+  // feed input to the net
+  float* pInput = input->mutable_cpu_data();
+  for (size_t i = 0; i < pairs.size(); i++)
+  {
+    pInput[2 * i] = static_cast<float>(pairs[i].first);
+    pInput[2 * i + 1] = static_cast<float>(pairs[i].second);
+  }
+
+  // forward pass
+  if (mlp)
+  {
+    stage.Start("quantized forward");
+    outputs->resize(pairs.size() * iNumOfOutputs);
+    mlp->Forward(input->cpu_data(), pairs.size(), &(*outputs)[0]);
+  }
+  else
+  {
+    stage.Stop();
+    if (profiler)
+    {
+      profiler->ForwardFrom(net, 0);
+    }
+    else
+    {
+      float loss = 0.0;
+      net->Forward(&loss);
+    }
+    stage.Start("copy output");
+    const float* pResult = net->output_blobs()[0]->cpu_data();
+    outputs->assign(pResult, pResult + pairs.size() * iNumOfOutputs);
+  }
+  const float* pResult = &(*outputs)[0];
+
+  // find maximum
+  stage.Start("argmax");
+  labels->resize(pairs.size());
+  ArgmaxChannels(pResult, iNumOfOutputs, pairs.size(), 1, iNumOfOutputs, &(*labels)[0]);
+}
+
+// Reads at most max_pairs pairs of values from in, returns false when there are no more.
+// A csv line without exactly two values is reported by its number (counted in lines) and
+// skipped, binary input that ends with a part of a pair is reported and ignored
+static bool
+ReadPairs(std::istream& in, const bool bBinary, const size_t max_pairs, std::vector<tPair>* pairs, long* lines)
+{
+  pairs->clear();
+  if (bBinary)
+  {
+    std::vector<int> vValues(2 * max_pairs);
+    in.read(reinterpret_cast<char*>(&vValues[0]), vValues.size() * sizeof(int));
+    const size_t iPairs = in.gcount() / (2 * sizeof(int));
+    const size_t iRest = in.gcount() % (2 * sizeof(int));
+    if (iRest != 0)
+    {
+      LOG(WARNING) << "Ignored the last " << iRest << " bytes of the input, a pair has " << 2 * sizeof(int) << " bytes";
+    }
+    for (size_t i = 0; i < iPairs; i++)
+    {
+      pairs->push_back(std::make_pair(vValues[2 * i], vValues[2 * i + 1]));
+    }
+  }
+  else
+  {
+    std::string sLine;
+    while (pairs->size() < max_pairs && std::getline(in, sLine))
+    {
+      (*lines)++;
+
+      // the values are separated by a comma and/or white space
+      const char* pBegin = sLine.c_str();
+      char* pEnd = NULL;
+      tPair pair;
+      pair.first = std::strtol(pBegin, &pEnd, 10);
+      if (pEnd == pBegin)
+      {
+        continue; // empty line or header
+      }
+      pBegin = pEnd + std::strspn(pEnd, ", \t");
+      pair.second = std::strtol(pBegin, &pEnd, 10);
+      if (pEnd == pBegin || pEnd[std::strspn(pEnd, ", \t\r")] != '\0')
+      {
+        LOG(WARNING) << "Skipped line " << *lines << ", expected two values: " << sLine;
+        continue;
+      }
+      pairs->push_back(pair);
+    }
+  }
+  return !pairs->empty();
+}
+
+// Classifies all pairs of in, batch_size pairs at a time, writes their classes to out
+// when given and reports the throughput and accuracy (compared to fp32 when asked)
+static void
+ClassifyStream(caffe::Net<float>* net, QuantizedMlp* mlp, Profiler* profiler, std::istream& in, std::ostream* out, std::ostream& log)
+{
+  const bool bCompare = mlp && FLAGS_compare_fp32;
+  std::vector<int> reference_labels;
+  std::vector<float> reference_outputs;
+  long iReferenceCorrect = 0;
+  long iReferenceEqual = 0;
+
+  const bool bBinary = FLAGS_input_format == "binary";
+  std::vector<tPair> pairs;
+  std::vector<int> labels;
+  std::vector<float> outputs;
+  long iLines = 0;
+  long iPairs = 0;
+  long iCorrect = 0;
+  long iBatches = 0;
+  double dForwardTime = 0;
+  double dReferenceForwardTime = 0;
+  double dCompareTime = 0;
+  caffe::CPUTimer timer, forward_timer, compare_timer;
+  timer.Start();
+  Profiler::Stage stage(profiler);
+  stage.Start("read");
+  while (ReadPairs(in, bBinary, FLAGS_batch_size, &pairs, &iLines))
+  {
+    stage.Stop();
+    forward_timer.Start();
+    ClassifyPairs(net, mlp, profiler, pairs, &labels, &outputs);
+    dForwardTime += forward_timer.Seconds();
+    iBatches++;
+
+    // the classes of the fp32 net, its time doesn't count
+    if (bCompare)
+    {
+      compare_timer.Start();
+      forward_timer.Start();
+      ClassifyPairs(net, NULL, NULL, pairs, &reference_labels, &reference_outputs);
+      dReferenceForwardTime += forward_timer.Seconds();
+      for (size_t i = 0; i < pairs.size(); i++)
+      {
+        iReferenceCorrect += ((pairs[i].first ^ pairs[i].second) == reference_labels[i]);
+        iReferenceEqual += (labels[i] == reference_labels[i]);
+      }
+      dCompareTime += compare_timer.Seconds();
+    }
+
+    stage.Start("write");
+    for (size_t i = 0; i < pairs.size(); i++)
+    {
+      // the XOR of the input is the ground truth
+      if ((pairs[i].first ^ pairs[i].second) == labels[i])
+      {
+        iCorrect++;
+      }
+      if (out)
+      {
+        *out << labels[i] << '\n';
+      }
+    }
+    iPairs += pairs.size();
+    stage.Start("read");
+  }
+  stage.Stop();
+  const double dSeconds = timer.Seconds() - dCompareTime;
+
+  log << "classified " << iPairs << " pairs in " << iBatches << " batches, "
+      << static_cast<double>(iCorrect) / std::max(iPairs, 1L) * 100 << "% correctly" << std::endl;
+  log << dSeconds << " seconds (" << dForwardTime << " forward), "
+      << (dSeconds > 0 ? iPairs / dSeconds : 0) << " pairs/s" << std::endl;
+  if (bCompare)
+  {
+    const double dAccuracy = static_cast<double>(iCorrect) / std::max(iPairs, 1L) * 100;
+    const double dReferenceAccuracy = static_cast<double>(iReferenceCorrect) / std::max(iPairs, 1L) * 100;
+    log << FLAGS_precision << " classified " << dAccuracy << "% correctly, fp32 " << dReferenceAccuracy
+        << "% (difference " << dAccuracy - dReferenceAccuracy << "%), the same class for "
+        << static_cast<double>(iReferenceEqual) / std::max(iPairs, 1L) * 100 << "% of the pairs" << std::endl;
+    log << FLAGS_precision << " forward " << dForwardTime << " seconds, fp32 " << dReferenceForwardTime << " seconds ("
+        << (dForwardTime > 0 ? dReferenceForwardTime / dForwardTime : 0) << " times as fast)" << std::endl;
+  }
+}
+
+// Server handler; a request is two values separated by white space, its response is the
+// class followed by the output values
+static void
+ServeRequests(caffe::Net<float>* net,
+              QuantizedMlp* mlp,
+              Profiler* profiler,
+              const std::vector<std::string>& requests,
+              std::vector<std::string>* responses)
+{
+  // parse the requests, the invalid ones are not classified
+  std::vector<tPair> pairs;
+  std::vector<bool> vValid(requests.size());
+  for (size_t i = 0; i < requests.size(); i++)
+  {
+    std::istringstream ss(requests[i]);
+    tPair pair;
+    std::string sRest;
+    vValid[i] = (ss >> pair.first >> pair.second) && !(ss >> sRest);
+    if (vValid[i])
+    {
+      pairs.push_back(pair);
+    }
+  }
+
+  std::vector<int> labels;
+  std::vector<float> outputs;
+  if (!pairs.empty())
+  {
+    ClassifyPairs(net, mlp, profiler, pairs, &labels, &outputs);
+  }
+
+  size_t iPair = 0;
+  for (size_t i = 0; i < requests.size(); i++)
+  {
+    if (!vValid[i])
+    {
+      responses->push_back("error: expected VALUE1 VALUE2");
+      continue;
+    }
+    std::ostringstream ss;
+    ss << labels[iPair];
+    for (int j = 0; j < iNumOfOutputs; j++)
+    {
+      ss << " " << outputs[iPair * iNumOfOutputs + j];
+    }
+    responses->push_back(ss.str());
+    iPair++;
+  }
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -27,71 +312,116 @@ main(int argc, char* argv[])
 
   gflags::SetUsageMessage("Classifies two values using a network and a trained model\n"
                           "Usage:\n"
-                          " classify-xor NET MODEL VALUE1 VALUE2\n");
+                          " classify-xor NET MODEL VALUE1 VALUE2\n"
+                          " classify-xor --server [FLAGS] NET MODEL\n"
+                          " classify-xor --input=FILE [FLAGS] NET MODEL\n"
+                          " classify-xor --packed [FLAGS] PACKED_NET ...\n");
   gflags::ParseCommandLineFlags(&argc, &argv, true);
 
-  if (argc != 5)
+  const bool bStream = !FLAGS_input.empty();
+  QuantizedMlp::tPrecision precision;
+  const bool bReducedPrecision = QuantizedMlp::ParsePrecision(FLAGS_precision, &precision);
+  const int iNetArgs = FLAGS_packed ? 1 : 2;
+  if (argc != 1 + iNetArgs + (FLAGS_server || bStream ? 0 : 2) || FLAGS_max_batch < 1 || FLAGS_batch_size < 1 ||
+      (!bReducedPrecision && FLAGS_precision != "fp32") ||
+      (FLAGS_input_format != "csv" && FLAGS_input_format != "binary"))
   {
     gflags::ShowUsageWithFlagsRestrict(argv[0], "classify-xor");
     return 1;
   }
 
-  // get the net
-  const std::string sNetwork = argv[1];
-  std::cout << "loading " << sNetwork << std::endl;
-  caffe::Net<float> caffe_test_net(sNetwork, caffe::TEST);
+  // a server uses stdout for its responses, a stream maybe for its classes
+  std::ostream& log = (FLAGS_server || FLAGS_output == "-") ? std::cerr : std::cout;
 
-  // get trained model
-  const std::string sModel = argv[2];
-  std::cout << "loading " << sModel << std::endl;
-  caffe_test_net.CopyTrainedLayersFrom(sModel);
+  // get the net and its trained model
+  caffe::CPUTimer load_timer;
+  load_timer.Start();
+  boost::scoped_ptr<PackedNet> packed_net;
+  boost::shared_ptr<caffe::Net<float> > net;
+  if (FLAGS_packed)
+  {
+    const std::string sPacked = argv[1];
+    log << "loading " << sPacked << std::endl;
+    packed_net.reset(new PackedNet(sPacked));
+    net = packed_net->CreateNet();
+  }
+  else
+  {
+    const std::string sNetwork = argv[1];
+    log << "loading " << sNetwork << std::endl;
+    net.reset(new caffe::Net<float>(sNetwork, caffe::TEST));
 
-  // read input values
-  const int iVal1 = std::atoi(argv[3]);
-  const int iVal2 = std::atoi(argv[4]);
-  std::cout << "Input value 1: " << iVal1 << " Input value 2: " << iVal2 << std::endl;
+    const std::string sModel = argv[2];
+    log << "loading " << sModel << std::endl;
+    net->CopyTrainedLayersFrom(sModel);
+  }
+  load_timer.Stop();
+  log << "loaded in " << load_timer.MilliSeconds() << " ms" << std::endl;
 
-  // two outputs; either 0 or 1
-  const int iNumOfOutputs = 2;
+  // times the layers and stages when asked
+  boost::scoped_ptr<Profiler> profiler;
+  if (!FLAGS_profile.empty())
+  {
+    profiler.reset(new Profiler());
+  }
 
-  // feed input to the net
-  // create input blob
-  caffe::BlobProto blob_proto;
-  caffe::BlobShape* shape = blob_proto.mutable_shape();
-  shape->add_dim(1);
-  shape->add_dim(iNumOfOutputs);
-  blob_proto.add_data((float)iVal1);
-  blob_proto.add_data((float)iVal2);
-  std::vector<int> vShape;
-  vShape.push_back(1);
-  vShape.push_back(iNumOfOutputs);
-  caffe::Blob<float> blob(vShape);
-
-  // set data into blob
-  blob.FromProto(blob_proto);
-
-  // fill the bottom vector
-  std::vector<caffe::Blob<float>*> bottom;
-  bottom.push_back(&blob);
+  // reduced precision copy of the net
+  boost::scoped_ptr<QuantizedMlp> mlp;
+  if (bReducedPrecision)
+  {
+    mlp.reset(new QuantizedMlp(*net, precision));
+  }
 
-  // forward pass
-  float loss = 0.0;
-  const std::vector<caffe::Blob<float>*>& result = caffe_test_net.Forward(bottom, &loss);
+  if (FLAGS_server)
+  {
+    LineServer server(FLAGS_socket, FLAGS_max_batch);
+    log << "serving " << (FLAGS_socket.empty() ? "stdin" : FLAGS_socket) << std::endl;
+    server.Run(boost::bind(&ServeRequests, net.get(), mlp.get(), profiler.get(), _1, _2));
+    if (profiler)
+    {
+      profiler->Write(FLAGS_profile, log);
+    }
+    return 0;
+  }
 
-  // find maximum
-  float max = -1;
-  int max_i = -1;
-  for (int i = 0; i < iNumOfOutputs; ++i)
+  if (bStream)
   {
-    const float value = (result[0]->cpu_data())[i];
-    std::cout << "index: " << i << " value: " << value << std::endl;
-    if (value > max)
+    std::ifstream input_file;
+    if (FLAGS_input != "-")
     {
-      max = value;
-      max_i = i;
+      input_file.open(FLAGS_input.c_str(), FLAGS_input_format == "binary" ? std::ios::binary : std::ios::in);
+      CHECK(input_file.good()) << "Cannot read " << FLAGS_input;
     }
+    std::ofstream output_file;
+    if (!FLAGS_output.empty() && FLAGS_output != "-")
+    {
+      output_file.open(FLAGS_output.c_str());
+      CHECK(output_file.good()) << "Cannot write " << FLAGS_output;
+    }
+    std::ostream* out = FLAGS_output.empty() ? NULL : (FLAGS_output == "-" ? &std::cout : &output_file);
+    ClassifyStream(net.get(), mlp.get(), profiler.get(), FLAGS_input == "-" ? std::cin : input_file, out, log);
+    if (profiler)
+    {
+      profiler->Write(FLAGS_profile, log);
+    }
+    return 0;
   }
 
+  // read input values
+  const int iVal1 = std::atoi(argv[1 + iNetArgs]);
+  const int iVal2 = std::atoi(argv[2 + iNetArgs]);
+  std::cout << "Input value 1: " << iVal1 << " Input value 2: " << iVal2 << std::endl;
+
+  // classify
+  std::vector<int> labels;
+  std::vector<float> outputs;
+  ClassifyPairs(net.get(), mlp.get(), profiler.get(), std::vector<tPair>(1, std::make_pair(iVal1, iVal2)), &labels, &outputs);
+  for (int i = 0; i < iNumOfOutputs; ++i)
+  {
+    std::cout << "index: " << i << " value: " << outputs[i] << std::endl;
+  }
+  const int max_i = labels[0];
+
   std::cout << "Result is: " << max_i << " classified    ";
   if ((iVal1^iVal2) == max_i)
   {
@@ -101,6 +431,10 @@ main(int argc, char* argv[])
   {
     std::cout << "BAD" << std::endl;
   }
+  if (profiler)
+  {
+    profiler->Write(FLAGS_profile, std::cout);
+  }
 
   return 0;
 }
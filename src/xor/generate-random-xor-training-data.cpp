@@ -11,7 +11,6 @@
 //
 
 #include <gflags/gflags.h>
-#include <boost/scoped_ptr.hpp>
 #include <caffe/proto/caffe.pb.h>
 #include <caffe/util/db.hpp>
 #include <caffe/util/io.hpp>
@@ -21,10 +20,18 @@
 #include <algorithm>
 #include <ctime>
 
+#include "sample-writer.hpp"
+#include "shuffle-buffer.hpp"
+
 // define gflags FLAGS and default values
 DEFINE_string(backend, "lmdb", "The backend {lmdb, leveldb} for storing the result");
 DEFINE_int32(split, 1, "Number of samples {nr} used for TRAIN before a sample is used for TEST, use negative value to do the opposite");
 DEFINE_bool(shuffle, true, "Randomly shuffle the order of samples");
+DEFINE_int32(shuffle_buffer, 100000, "Number of samples {nr} kept in memory for shuffling, the order is completely random when all samples fit");
+DEFINE_int32(shards, 1, "Number of databases {nr} per TRAIN and TEST split");
+DEFINE_int32(queue_size, 10000, "Number of samples {nr} that can wait to be written to the DB");
+DEFINE_int32(commit_samples, 1000, "Commit to the DB after {nr} samples, 0 for no limit");
+DEFINE_int32(commit_mb, 64, "Commit to the DB after {nr} MB, 0 for no limit");
 
 int
 main(int argc, char* argv[])
@@ -41,7 +48,7 @@ main(int argc, char* argv[])
                           " generate-random-xor-training-data [FLAGS] NR_OF_SAMPLES DB_NAME\n");
   gflags::ParseCommandLineFlags(&argc, &argv, true);
 
-  if (argc != 3)
+  if (argc != 3 || FLAGS_shards < 1)
   {
     gflags::ShowUsageWithFlagsRestrict(argv[0], "generate-random-xor-training-data");
     return 1;
@@ -52,146 +59,63 @@ main(int argc, char* argv[])
 
   const int iNumberOfSamples = std::atoi(argv[1]);
 
+  // the samples are written to the train and test DB by a writer thread, on the way
+  // there they are shuffled in a buffer of limited size
+  SampleWriter writer(FLAGS_backend, argv[2], FLAGS_split, FLAGS_shards, FLAGS_queue_size,
+                      FLAGS_commit_samples, static_cast<size_t>(FLAGS_commit_mb) << 20);
+  typedef int tLabel;
+  typedef std::pair<std::string, tLabel> tSample; // serialized caffe::Datum and its label
+  ShuffleBuffer<tSample> shuffle_buffer(FLAGS_shuffle_buffer, std::rand());
+
   // generate random data
   typedef int tInput;
   typedef std::pair<tInput, tInput> tData;
-  typedef int tLabel;
-  typedef std::pair<tData, tLabel> tSample;
-  typedef std::vector<tSample> tSamples;
-  tSamples samples;
-  {
-    for (int i = 0; i < iNumberOfSamples; i++)
-    {
-      const double dRandom1 = (double)std::rand() / RAND_MAX;
-      const double dRandom2 = (double)std::rand() / RAND_MAX;
-      const tData data = std::make_pair(dRandom1 > 0.5 ? 1 : 0, dRandom2 > 0.5 ? 1 : 0);
-      // XOR data to get label
-      const tLabel label = data.first ^ data.second;
-      const tSample sample = std::make_pair(data, label);
-      samples.push_back(sample);
-    }
-  }
-
-  // shuffle the data
-  if (FLAGS_shuffle == true)
+  tSample out, shuffled;
+  for (int i = 0; i < iNumberOfSamples; i++)
   {
-    // randomly shuffle samples
-    std::random_shuffle(samples.begin(), samples.end());
-  }
-
-  // Create new train and test DB
-  boost::scoped_ptr<caffe::db::DB> train_db(caffe::db::GetDB(FLAGS_backend));
-  std::string dbTrainName = argv[2];
-  dbTrainName += "_train";
-  train_db->Open(dbTrainName.c_str(), caffe::db::NEW);
-  boost::scoped_ptr<caffe::db::Transaction> train_txn(train_db->NewTransaction());
-
-  boost::scoped_ptr<caffe::db::DB> test_db(caffe::db::GetDB(FLAGS_backend));
-  std::string dbTestName = argv[2];
-  dbTestName += "_test";
-  test_db->Open(dbTestName.c_str(), caffe::db::NEW);
-  boost::scoped_ptr<caffe::db::Transaction> test_txn(test_db->NewTransaction());
-
-  // divide the train/test data, determine spliting tactic
-  const int iSplitRate = FLAGS_split;
-  int iNumberPutToTrain = 0;
-  int iNumberPutToTest = 0;
-  enum eNextSample {eNSTrain, eNSTest};
-  eNextSample nextSample = eNSTrain; // always start with train samples
-
-  // convert samples to caffe::Datum
-  int iCount = 0, iCountTrain = 0, iCountTest = 0;
-  for (tSamples::const_iterator itrSample = samples.begin()
-                              ; itrSample != samples.end()
-                              ; ++itrSample)
-  {
-    // extract label from sample
-    const int iLabel = itrSample->second;
+    const double dRandom1 = (double)std::rand() / RAND_MAX;
+    const double dRandom2 = (double)std::rand() / RAND_MAX;
+    const tData data = std::make_pair(dRandom1 > 0.5 ? 1 : 0, dRandom2 > 0.5 ? 1 : 0);
+    // XOR data to get label
+    const tLabel label = data.first ^ data.second;
 
     // convert data to protobuf Datum
     caffe::Datum datum;
     datum.set_channels(2);
     datum.set_height(1);
     datum.set_width(1);
-    datum.set_label(iLabel);
-    datum.add_float_data(itrSample->first.first);
-    datum.add_float_data(itrSample->first.second);
-
-    // write datum to db use the sample number as key for db
-    std::string out;
-    CHECK(datum.SerializeToString(&out));
-    std::stringstream ss;
-    ss << iCount;
-
-    // put sample
-    if (nextSample == eNSTrain) // always start with train samples
-    {
-      train_txn->Put(ss.str(), out);
-      iNumberPutToTrain++;
-      iCountTrain++;
-    }
-    else if (nextSample == eNSTest)
-    {
-      test_txn->Put(ss.str(), out);
-      iNumberPutToTest++;
-      iCountTest++;
-    }
-
-    // determine where next sample should go
-    if (iSplitRate == 0)
-    {
-      nextSample = eNSTrain;
-    }
-    else if (iSplitRate < 0)
-    {
-      if (iNumberPutToTest == std::abs(iSplitRate))
-      {
-        nextSample = eNSTrain;
-        iNumberPutToTest = 0;
-      }
-      else
-      {
-        nextSample = eNSTest;
-      }
-    }
-    else if (iSplitRate > 0)
-    {
-      if (iNumberPutToTrain == iSplitRate)
-      {
-        nextSample = eNSTest;
-        iNumberPutToTrain = 0;
-      }
-      else
-      {
-        nextSample = eNSTrain;
-      }
-    }
+    datum.set_label(label);
+    datum.add_float_data(data.first);
+    datum.add_float_data(data.second);
+    out.second = label;
+    CHECK(datum.SerializeToString(&out.first));
 
-    // every 1000 samples commit to db
-    if (iCountTrain % 1000 == 0)
+    // randomly shuffle samples
+    if (FLAGS_shuffle == false)
     {
-      train_txn->Commit();
-      train_txn.reset(train_db->NewTransaction());
+      writer.Put(out.first, out.second);
     }
-    if (iCountTest % 1000 == 0)
+    else if (shuffle_buffer.Add(out, &shuffled))
     {
-      test_txn->Commit();
-      test_txn.reset(test_db->NewTransaction());
+      writer.Put(shuffled.first, shuffled.second);
     }
-
-    iCount++;
   }
 
-  // commit the last unwritten batch
-  if (iCountTrain % 1000 != 0)
+  // write the samples that are still in the shuffle buffer
+  std::vector<tSample> remaining;
+  shuffle_buffer.Flush(&remaining);
+  for (size_t i = 0; i < remaining.size(); i++)
   {
-    train_txn->Commit();
+    writer.Put(remaining[i].first, remaining[i].second);
   }
-  if (iCountTest % 1000 != 0)
+  writer.Close();
+
+  std::cout << "Total of " << writer.count() << " samples generated, put " << writer.count_train() << " to TRAIN DB and " << writer.count_test() << " to TEST DB" << std::endl;
+  std::cout << "Written " << writer.bytes() / 1048576.0 << " MB in " << writer.commits() << " commits, " << writer.write_seconds() << " seconds writing the databases";
+  if (writer.write_seconds() > 0) // 0 when nothing was written or it was too fast to time
   {
-    test_txn->Commit();
+    std::cout << " (" << writer.bytes() / 1048576.0 / writer.write_seconds() << " MB/s)";
   }
-
-  std::cout << "Total of " << iCount << " samples generated, put " << iCountTrain << " to TRAIN DB and " << iCountTest << " to TEST DB" << std::endl;
+  std::cout << ", " << writer.seconds() << " seconds end-to-end" << std::endl;
   return 0;
 }
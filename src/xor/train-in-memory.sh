@@ -0,0 +1,3 @@
+#!/usr/bin/env sh
+
+../../build/src/xor/train-xor solver.prototxt
@@ -0,0 +1,40 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Boaz Stolk
+//
+// For full license view project root directory
+
+// This program trains the net of a solver with random samples that are generated while
+// it trains, instead of samples read from a database.
+// Usage:
+//  train-xor [FLAGS] SOLVER
+//
+
+#include <boost/bind.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <vector>
+
+#include "train-in-memory.hpp"
+
+// Generates a number of random pairs of 0 and 1, labeled with their XOR
+static void
+GenerateSamples(boost::mt19937* rng, std::vector<MemoryFeed::tSample>* samples)
+{
+  boost::random::uniform_int_distribution<int> random(0, 1);
+  for (int i = 0; i < 1000; i++)
+  {
+    const int iValue1 = random(*rng);
+    const int iValue2 = random(*rng);
+    std::vector<float> data(2);
+    data[0] = iValue1;
+    data[1] = iValue2;
+    samples->push_back(MemoryFeed::tSample(data, iValue1 ^ iValue2));
+  }
+}
+
+int
+main(int argc, char* argv[])
+{
+  // samples of two values, all samples are independent so a small shuffle buffer will do
+  return TrainInMemory(argc, argv, "train-xor", boost::bind(&GenerateSamples, _1, _2), 2, 1000);
+}